@@ -0,0 +1,127 @@
+//========================================================//
+//  arena.c                                               //
+//  Source file for the predictor table arena             //
+//                                                        //
+//  Blocks smaller than a huge page come from the heap    //
+//  and are cleared with one memset. Larger blocks are    //
+//  anonymous mappings, which the kernel hands out        //
+//  zeroed, aligned to a huge page so that transparent    //
+//  huge pages can back all of it.                        //
+//========================================================//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+const char *backingName[4] = {"heap", "small pages", "transparent huge pages", "huge pages"};
+
+static inline size_t
+round_up(size_t bytes, size_t unit) {
+    return (bytes + unit - 1) / unit * unit;
+}
+
+size_t
+arena_round(size_t bytes) {
+    return round_up(bytes, ARENA_ALIGN);
+}
+
+// map 'len' bytes aligned to a huge page, advised to use transparent
+// huge pages unless 'small'
+static uint8_t *
+map_aligned(size_t len, int small, arena_t *arena) {
+    size_t over = len + ARENA_HUGE_PAGE;
+    uint8_t *map = (uint8_t *) mmap(NULL, over, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    // trim the mapping to the aligned part
+    uint8_t *base = (uint8_t *) round_up((uintptr_t) map, ARENA_HUGE_PAGE);
+    if (base > map) {
+        munmap(map, base - map);
+    }
+    if (base + len < map + over) {
+        munmap(base + len, map + over - (base + len));
+    }
+    arena->mapping = base;
+    arena->mapLen = len;
+    arena->backing = BACKING_SMALL;
+#ifdef MADV_HUGEPAGE
+    if (!small && madvise(base, len, MADV_HUGEPAGE) == 0) {
+        arena->backing = BACKING_THP;
+    }
+#endif
+    return base;
+}
+
+// Get a zeroed block of 'bytes' for 'arena' with page policy 'pages'
+//
+// Returns True if Successful
+//
+int
+arena_init(arena_t *arena, size_t bytes, int pages) {
+    memset(arena, 0, sizeof(arena_t));
+    size_t len = arena_round(bytes);
+    if (len == 0) {
+        len = ARENA_ALIGN;
+    }
+
+    if (len < ARENA_HUGE_PAGE && pages != PAGES_HUGE) {
+        void *block = NULL;
+        if (posix_memalign(&block, ARENA_ALIGN, len) != 0) {
+            return 0;
+        }
+        memset(block, 0, len);
+        arena->base = (uint8_t *) block;
+        arena->backing = BACKING_HEAP;
+    } else {
+        len = round_up(len, ARENA_HUGE_PAGE);
+#ifdef MAP_HUGETLB
+        if (pages == PAGES_HUGE) {
+            void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (map != MAP_FAILED) {
+                arena->base = arena->mapping = (uint8_t *) map;
+                arena->mapLen = len;
+                arena->backing = BACKING_HUGETLB;
+            }
+        }
+#endif
+        if (arena->base == NULL) {
+            arena->base = map_aligned(len, pages == PAGES_SMALL, arena);
+        }
+        if (arena->base == NULL) {
+            return 0;
+        }
+    }
+    arena->size = len;
+    return 1;
+}
+
+// Take 'bytes' of zeroes from the arena, cache line aligned
+//
+// Returns NULL if the arena is too small
+//
+void *
+arena_alloc(arena_t *arena, size_t bytes) {
+    size_t len = arena_round(bytes);
+    if (len > arena->size - arena->used) {
+        return NULL;
+    }
+    void *p = arena->base + arena->used;
+    arena->used += len;
+    return p;
+}
+
+// Release the whole block, every allocation from it becomes invalid
+//
+void
+arena_release(arena_t *arena) {
+    if (arena->mapping != NULL) {
+        munmap(arena->mapping, arena->mapLen);
+    } else {
+        free(arena->base);
+    }
+    memset(arena, 0, sizeof(arena_t));
+}
@@ -0,0 +1,73 @@
+//========================================================//
+//  arena.h                                               //
+//  Header file for the predictor table arena             //
+//                                                        //
+//  All tables of a predictor instance are carved out of  //
+//  one zeroed block sized from its configuration, each   //
+//  on its own cache lines. Large blocks are backed by    //
+//  huge pages when the system gives them, which cuts     //
+//  the TLB misses of big tables, and the whole instance  //
+//  is freed with one call.                               //
+//========================================================//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Alignment of every allocation, one cache line
+#define ARENA_ALIGN       64
+
+// Size of a huge page, blocks at least this large may use them
+#define ARENA_HUGE_PAGE   ((size_t) 2 << 20)
+
+//------------------------------------//
+//          Page Policies             //
+//------------------------------------//
+#define PAGES_TRANSPARENT 0   // transparent huge pages for large blocks
+#define PAGES_SMALL       1   // never ask for huge pages
+#define PAGES_HUGE        2   // reserved huge pages (MAP_HUGETLB), then
+                              // transparent ones, then small pages
+
+// How the block of an arena was obtained
+#define BACKING_HEAP      0   // aligned malloc, blocks below one huge page
+#define BACKING_SMALL     1   // anonymous mapping of small pages
+#define BACKING_THP       2   // mapping advised to use transparent huge pages
+#define BACKING_HUGETLB   3   // mapping of reserved huge pages
+extern const char *backingName[];
+
+typedef struct {
+    uint8_t *base;
+    size_t size;          // usable bytes
+    size_t used;
+    uint8_t *mapping;     // start and length of the mapping to release
+    size_t mapLen;
+    int backing;
+} arena_t;
+
+//------------------------------------//
+//      Arena Function Prototypes     //
+//------------------------------------//
+
+// 'bytes' rounded up to whole cache lines, add these up to size an arena
+//
+size_t arena_round(size_t bytes);
+
+// Get a zeroed block of 'bytes' for 'arena' with page policy 'pages'
+//
+// Returns True if Successful
+//
+int arena_init(arena_t *arena, size_t bytes, int pages);
+
+// Take 'bytes' of zeroes from the arena, cache line aligned
+//
+// Returns NULL if the arena is too small
+//
+void *arena_alloc(arena_t *arena, size_t bytes);
+
+// Release the whole block, every allocation from it becomes invalid
+//
+void arena_release(arena_t *arena);
+
+#endif
@@ -0,0 +1,508 @@
+//========================================================//
+//  bench.c                                               //
+//  Microbenchmarks of the predictors and trace readers   //
+//                                                        //
+//  Times the predict, train and fused steps of every     //
+//  predictor type on branches held in memory, and the    //
+//  reading of every trace format, on a synthetic trace   //
+//  and on the traces given. Each benchmark runs a few    //
+//  untimed warm-up rounds before the timed ones, and     //
+//  the nanoseconds per branch of every round go to a     //
+//  JSON report so builds can be compared.                //
+//========================================================//
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "predictor.h"
+#include "seekable.h"
+#include "simd.h"
+#include "trace.h"
+
+#define BENCH_MAX_RUNS   100
+#define BENCH_BATCH      4096
+#define BENCH_TEMP       "bench_trace"
+
+// Synthetic trace: static branches of four kinds, see synthesize()
+#define SYNTHETIC_STATIC 1024
+
+const char *defaultSpecs[] = {"static", "gshare:13", "tournament:9:10:10", "custom", "tage"};
+#define DEFAULT_SPECS    5
+
+//------------------------------------//
+//            Options                 //
+//------------------------------------//
+
+uint64_t maxBranches = 1 << 20;  // branches per trace, and of the synthetic one
+int warmup = 1;                  // untimed rounds before the timed ones
+int runs = 5;                    // timed rounds
+int threads = 1;                 // decompression threads
+char *jsonPath = NULL;           // JSON report, stdout if NULL
+const char **specs = NULL;       // predictor configurations
+int numSpecs = 0;
+char **tracePaths = NULL;
+int numTraces = 0;
+int simdLevel;                   // perceptron kernel
+
+//------------------------------------//
+//            Results                 //
+//------------------------------------//
+
+typedef struct {
+    const char *benchmark;       // "predict", "train", "fused" or "read"
+    char subject[64];            // predictor spec or trace format
+    const char *kernel;          // predictor loops, NULL for readers
+    char trace[256];
+    uint64_t branches;           // per round
+    double ns[BENCH_MAX_RUNS];   // per branch, of every timed round
+} result_t;
+
+result_t *results = NULL;
+int numResults = 0;
+
+volatile uint32_t sink;          // keeps the predictions alive
+
+static double
+now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// min, median, mean and standard deviation of the rounds of 'r'
+static void
+summarize(const result_t *r, double *min, double *median, double *mean, double *stddev) {
+    double sorted[BENCH_MAX_RUNS];
+    memcpy(sorted, r->ns, runs * sizeof(double));
+    qsort(sorted, runs, sizeof(double), compare_doubles);
+    *min = sorted[0];
+    *median = (runs % 2) ? sorted[runs / 2] : (sorted[runs / 2 - 1] + sorted[runs / 2]) / 2;
+    double sum = 0, squares = 0;
+    for (int k = 0; k < runs; k++) {
+        sum += r->ns[k];
+    }
+    *mean = sum / runs;
+    for (int k = 0; k < runs; k++) {
+        squares += (r->ns[k] - *mean) * (r->ns[k] - *mean);
+    }
+    *stddev = (runs > 1) ? sqrt(squares / (runs - 1)) : 0;
+}
+
+// One round of a benchmark: the seconds of its timed part, and the
+// branches it handled in 'branches'
+typedef double (*round_fn)(void *arg, uint64_t *branches);
+
+// Run 'round' warm-up and timed rounds into a new result
+static result_t *
+measure(const char *benchmark, const char *subject, const char *trace, round_fn round, void *arg) {
+    results = (result_t *) realloc(results, (numResults + 1) * sizeof(result_t));
+    result_t *r = &results[numResults++];
+    memset(r, 0, sizeof(result_t));
+    r->benchmark = benchmark;
+    strncpy(r->subject, subject, sizeof(r->subject) - 1);
+    strncpy(r->trace, trace, sizeof(r->trace) - 1);
+
+    for (int k = 0; k < warmup; k++) {
+        round(arg, &r->branches);
+    }
+    for (int k = 0; k < runs; k++) {
+        double seconds = round(arg, &r->branches);
+        r->ns[k] = (r->branches > 0) ? seconds * 1e9 / r->branches : 0;
+    }
+
+    double min, median, mean, stddev;
+    summarize(r, &min, &median, &mean, &stddev);
+    fprintf(stderr, "%-8s %-22s %-12s %8.2f ns/branch (+-%.2f)\n", benchmark, subject, trace, median, stddev);
+    return r;
+}
+
+//------------------------------------//
+//        Predictor Benchmarks        //
+//------------------------------------//
+
+typedef struct {
+    predictor_config_t config;
+    const uint32_t *pcs;
+    const uint8_t *outcomes;
+    size_t n;
+} predictor_bench_t;
+
+// predictor_predict() on a predictor trained with the whole trace
+static double
+predict_round(void *arg, uint64_t *branches) {
+    predictor_bench_t *b = (predictor_bench_t *) arg;
+    predictor_t *p = predictor_create(&b->config);
+    predict_and_train(p, b->pcs, b->outcomes, b->n, NULL);
+
+    uint32_t taken = 0;
+    double start = now();
+    for (size_t i = 0; i < b->n; i++) {
+        taken += predictor_predict(p, b->pcs[i]);
+    }
+    double seconds = now() - start;
+    sink = taken;
+    predictor_destroy(p);
+    *branches = b->n;
+    return seconds;
+}
+
+// predictor_train() one branch at a time from cold tables
+static double
+train_round(void *arg, uint64_t *branches) {
+    predictor_bench_t *b = (predictor_bench_t *) arg;
+    predictor_t *p = predictor_create(&b->config);
+
+    double start = now();
+    for (size_t i = 0; i < b->n; i++) {
+        predictor_train(p, b->pcs[i], b->outcomes[i]);
+    }
+    double seconds = now() - start;
+    predictor_destroy(p);
+    *branches = b->n;
+    return seconds;
+}
+
+// predict_and_train() over the whole trace from cold tables
+static double
+fused_round(void *arg, uint64_t *branches) {
+    predictor_bench_t *b = (predictor_bench_t *) arg;
+    predictor_t *p = predictor_create(&b->config);
+
+    double start = now();
+    sink = predict_and_train(p, b->pcs, b->outcomes, b->n, NULL);
+    double seconds = now() - start;
+    predictor_destroy(p);
+    *branches = b->n;
+    return seconds;
+}
+
+static void
+bench_predictors(const char *trace, const uint32_t *pcs, const uint8_t *outcomes, size_t n) {
+    for (int s = 0; s < numSpecs; s++) {
+        predictor_bench_t b;
+        predictor_parse_config(specs[s], &b.config);
+        b.pcs = pcs;
+        b.outcomes = outcomes;
+        b.n = n;
+
+        predictor_t *p = predictor_create(&b.config);
+        const char *kernel = predictor_kernel_name(p);
+        predictor_destroy(p);
+
+        measure("predict", specs[s], trace, predict_round, &b)->kernel = kernel;
+        measure("train", specs[s], trace, train_round, &b)->kernel = kernel;
+        measure("fused", specs[s], trace, fused_round, &b)->kernel = kernel;
+    }
+}
+
+//------------------------------------//
+//       Trace Reader Benchmarks      //
+//------------------------------------//
+
+// open 'path' and read it to the end with trace_read_batch()
+static double
+read_round(void *arg, uint64_t *branches) {
+    const char *path = (const char *) arg;
+    uint32_t pcs[BENCH_BATCH];
+    uint8_t outcomes[BENCH_BATCH];
+
+    double start = now();
+    trace_t *trace = trace_open(path, threads);
+    uint64_t count = 0;
+    size_t n;
+    while (trace != NULL && (n = trace_read_batch(trace, pcs, outcomes, BENCH_BATCH)) > 0) {
+        count += n;
+    }
+    if (trace != NULL) {
+        trace_close(trace);
+    }
+    double seconds = now() - start;
+    *branches = count;
+    return seconds;
+}
+
+static void
+remove_temp(const char *ext) {
+    char path[64];
+    snprintf(path, sizeof(path), BENCH_TEMP ".%s", ext);
+    remove(path);
+}
+
+// Write the branches as a text trace and convert it to every binary
+// format, each read back in turn
+//
+// Returns True if Successful
+//
+static int
+bench_readers(const char *trace, const uint32_t *pcs, const uint8_t *outcomes, size_t n) {
+    FILE *text = fopen(BENCH_TEMP ".txt", "w");
+    if (text == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        fprintf(text, "0x%x %d\n", pcs[i], outcomes[i]);
+    }
+    if (fclose(text) != 0) {
+        return 0;
+    }
+
+    int ok = 1;
+    trace_t *t;
+    if ((t = trace_open(BENCH_TEMP ".txt", 1)) != NULL) {
+        ok &= trace_convert(t, BENCH_TEMP ".bpt") == (int64_t) n;
+        trace_close(t);
+    }
+    if ((t = trace_open(BENCH_TEMP ".txt", 1)) != NULL) {
+        ok &= trace_convert_seekable(t, BENCH_TEMP ".bps", SEEKABLE_FRAME_BRANCHES) == (int64_t) n;
+        trace_close(t);
+    }
+    if ((t = trace_open(BENCH_TEMP ".txt", 1)) != NULL) {
+        ok &= trace_convert_dictionary(t, BENCH_TEMP ".bpd") == (int64_t) n;
+        trace_close(t);
+    }
+
+    if (ok) {
+        measure("read", "text", trace, read_round, BENCH_TEMP ".txt");
+        measure("read", "binary", trace, read_round, BENCH_TEMP ".bpt");
+        measure("read", "seekable", trace, read_round, BENCH_TEMP ".bps");
+        measure("read", "dictionary", trace, read_round, BENCH_TEMP ".bpd");
+    }
+    remove_temp("txt");
+    remove_temp("bpt");
+    remove_temp("bps");
+    remove_temp("bpd");
+    return ok;
+}
+
+//------------------------------------//
+//             Traces                 //
+//------------------------------------//
+
+static uint32_t
+next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+// Branches drawn from SYNTHETIC_STATIC static branches: loops with
+// short trip counts, biased branches, branches that copy an older
+// outcome of the global history, and coin flips
+static void
+synthesize(uint32_t *pcs, uint8_t *outcomes, size_t n) {
+    uint32_t seed = 240;
+    uint32_t trips[SYNTHETIC_STATIC];
+    memset(trips, 0, sizeof(trips));
+    uint64_t history = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t b = next_random(&seed) % SYNTHETIC_STATIC;
+        uint8_t outcome;
+        switch (b & 3) {
+            case 0:
+                outcome = (++trips[b] % (4 + (b >> 2) % 13)) != 0;
+                break;
+            case 1:
+                outcome = next_random(&seed) % 16 != 0;
+                break;
+            case 2:
+                outcome = (history >> ((b >> 2) % 16)) & 1;
+                break;
+            default:
+                outcome = next_random(&seed) & 1;
+                break;
+        }
+        pcs[i] = 0x400000 + b * 16;
+        outcomes[i] = outcome;
+        history = (history << 1) | outcome;
+    }
+}
+
+// Read the first maxBranches branches of 'path' into memory
+//
+// Returns the number of branches, 0 if the trace cannot be read
+//
+static size_t
+load(const char *path, uint32_t *pcs, uint8_t *outcomes) {
+    trace_t *trace = trace_open(path, threads);
+    if (trace == NULL) {
+        return 0;
+    }
+    size_t n = 0, m;
+    while (n < maxBranches &&
+           (m = trace_read_batch(trace, pcs + n, outcomes + n,
+                                 (maxBranches - n < BENCH_BATCH) ? maxBranches - n : BENCH_BATCH)) > 0) {
+        n += m;
+    }
+    trace_close(trace);
+    return n;
+}
+
+// file name of 'path' without its directory
+static const char *
+base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int
+ends_with(const char *s, const char *suffix) {
+    size_t len = strlen(s), slen = strlen(suffix);
+    return len >= slen && !strcmp(s + len - slen, suffix);
+}
+
+//------------------------------------//
+//            JSON Report             //
+//------------------------------------//
+
+static void
+write_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+        }
+        if ((unsigned char) *s >= 0x20) {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void
+write_json(FILE *out) {
+    fprintf(out, "{\n  \"build\": {\"compiler\": ");
+    write_string(out, __VERSION__);
+    fprintf(out, ", \"date\": ");
+    write_string(out, __DATE__ " " __TIME__);
+    fprintf(out, ", \"simd\": ");
+    write_string(out, simdName[simdLevel]);
+    fprintf(out, "},\n  \"settings\": {\"branches\": %llu, \"warmup\": %d, \"runs\": %d, \"threads\": %d},\n",
+            (unsigned long long) maxBranches, warmup, runs, threads);
+    fprintf(out, "  \"results\": [\n");
+    for (int k = 0; k < numResults; k++) {
+        const result_t *r = &results[k];
+        double min, median, mean, stddev;
+        summarize(r, &min, &median, &mean, &stddev);
+        fprintf(out, "    {\"benchmark\": \"%s\", \"subject\": ", r->benchmark);
+        write_string(out, r->subject);
+        fprintf(out, ", \"trace\": ");
+        write_string(out, r->trace);
+        if (r->kernel != NULL) {
+            fprintf(out, ", \"kernel\": \"%s\"", r->kernel);
+        }
+        fprintf(out, ", \"branches\": %llu,\n", (unsigned long long) r->branches);
+        fprintf(out, "     \"ns_per_branch\": {\"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f},\n",
+                min, median, mean, stddev);
+        fprintf(out, "     \"runs\": [");
+        for (int i = 0; i < runs; i++) {
+            fprintf(out, "%s%.3f", i ? ", " : "", r->ns[i]);
+        }
+        fprintf(out, "]}%s\n", (k + 1 < numResults) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+//------------------------------------//
+//               Main                 //
+//------------------------------------//
+
+void
+usage() {
+    fprintf(stderr, "Usage: benchmark <options> [<trace> ...]\n");
+    fprintf(stderr, " --branches:<n>    Branches of the synthetic trace, and read from each trace (1048576)\n");
+    fprintf(stderr, " --warmup:<n>      Untimed rounds before the timed ones (1)\n");
+    fprintf(stderr, " --runs:<n>        Timed rounds, at most %d (5)\n", BENCH_MAX_RUNS);
+    fprintf(stderr, " --threads:<n>     Threads for bzip2 traces (1)\n");
+    fprintf(stderr, " --json:<file>     Write the report to <file> instead of stdout\n");
+    fprintf(stderr, " --<type>          Predictor to measure, repeat for several (static, gshare:13,\n"
+                    "                   tournament:9:10:10, custom and tage)\n");
+}
+
+int
+main(int argc, char *argv[]) {
+    specs = (const char **) malloc(argc * sizeof(char *));
+    tracePaths = (char **) malloc(argc * sizeof(char *));
+    for (int i = 1; i < argc; i++) {
+        unsigned long long n;
+        predictor_config_t config;
+        if (!strncmp(argv[i], "--branches:", 11) && sscanf(argv[i] + 11, "%llu", &n) == 1 && n > 0) {
+            maxBranches = n;
+        } else if (!strncmp(argv[i], "--warmup:", 9) && sscanf(argv[i] + 9, "%d", &warmup) == 1 && warmup >= 0) {
+        } else if (!strncmp(argv[i], "--runs:", 7) && sscanf(argv[i] + 7, "%d", &runs) == 1 &&
+                   runs > 0 && runs <= BENCH_MAX_RUNS) {
+        } else if (!strncmp(argv[i], "--threads:", 10) && sscanf(argv[i] + 10, "%d", &threads) == 1 &&
+                   threads > 0) {
+        } else if (!strncmp(argv[i], "--json:", 7) && argv[i][7] != '\0') {
+            jsonPath = argv[i] + 7;
+        } else if (!strncmp(argv[i], "--", 2) && predictor_parse_config(argv[i] + 2, &config)) {
+            specs[numSpecs++] = argv[i] + 2;
+        } else if (strncmp(argv[i], "--", 2)) {
+            tracePaths[numTraces++] = argv[i];
+        } else {
+            fprintf(stderr, "Unrecognized option '%s'\n", argv[i]);
+            usage();
+            exit(1);
+        }
+    }
+    if (numSpecs == 0) {
+        memcpy(specs, defaultSpecs, sizeof(defaultSpecs));
+        numSpecs = DEFAULT_SPECS;
+    }
+
+    simdLevel = simd_init();
+    uint32_t *pcs = (uint32_t *) malloc(maxBranches * sizeof(uint32_t));
+    uint8_t *outcomes = (uint8_t *) malloc(maxBranches);
+
+    // the synthetic trace
+    synthesize(pcs, outcomes, maxBranches);
+    bench_predictors("synthetic", pcs, outcomes, maxBranches);
+    if (!bench_readers("synthetic", pcs, outcomes, maxBranches)) {
+        fprintf(stderr, "Cannot write the temporary traces " BENCH_TEMP ".*\n");
+        exit(1);
+    }
+
+    // the traces given, bzip2 ones are also read whole
+    for (int t = 0; t < numTraces; t++) {
+        size_t n = load(tracePaths[t], pcs, outcomes);
+        if (n == 0) {
+            fprintf(stderr, "Cannot read trace %s\n", tracePaths[t]);
+            exit(1);
+        }
+        const char *name = base_name(tracePaths[t]);
+        bench_predictors(name, pcs, outcomes, n);
+        if (!bench_readers(name, pcs, outcomes, n)) {
+            fprintf(stderr, "Cannot write the temporary traces " BENCH_TEMP ".*\n");
+            exit(1);
+        }
+        if (ends_with(tracePaths[t], ".bz2")) {
+            measure("read", "bzip2", name, read_round, tracePaths[t]);
+        }
+    }
+
+    FILE *out = (jsonPath != NULL) ? fopen(jsonPath, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Cannot write %s\n", jsonPath);
+        exit(1);
+    }
+    write_json(out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    free(pcs);
+    free(outcomes);
+    free(results);
+    free(specs);
+    free(tracePaths);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+# Compare the tournament predictor with the global counters and selectors
+# in one interleaved table (default) against two separate tables
+# (-DSPLIT_SELECTOR) at large ghistoryBits, on every bundled trace.
+# Reports cache misses with perf if available, else the D1/LL misses of
+# valgrind's cachegrind, and always the wall time.
+# usage: ./benchLayout.sh [ghistoryBits ...]
+
+OPTS="-g -O2 -std=c99 -Werror -pthread"
+FILES="../traces/*"
+GHISTORY_BITS=${@:-20 24}
+LOCAL_BITS='10:10'
+
+make clean > /dev/null
+make OPTS="$OPTS -DSPLIT_SELECTOR" > /dev/null || exit 1
+mv predictor predictor_split
+make clean > /dev/null
+make OPTS="$OPTS" > /dev/null || exit 1
+
+if command -v perf > /dev/null && perf stat -e cache-misses true > /dev/null 2>&1; then
+  TOOL=perf
+elif command -v valgrind > /dev/null; then
+  TOOL=cachegrind
+else
+  TOOL=time
+fi
+
+# print "<seconds> <cache misses>" for one run
+measure() {
+  local start end misses
+  start=$(date +%s%N)
+  case $TOOL in
+    perf)
+      misses=$(perf stat -x, -e cache-misses "$@" 2>&1 > /dev/null | grep cache-misses | cut -d, -f1)
+      ;;
+    cachegrind)
+      misses=$(valgrind --tool=cachegrind --cache-sim=yes --cachegrind-out-file=/dev/null "$@" 2>&1 > /dev/null |
+               grep "LL misses" | head -1 | awk '{ gsub(",", "", $4); print $4 }')
+      ;;
+    *)
+      "$@" > /dev/null
+      misses=-
+      ;;
+  esac
+  end=$(date +%s%N)
+  echo "$(( (end - start) / 1000000 )) $misses"
+}
+
+# decode every trace once, so the runs measure the predictor and not bzip2
+BINDIR=$(mktemp -d)
+for f in $FILES
+do
+  ./predictor --convert:$BINDIR/$(basename $f .bz2).bpt $f > /dev/null
+done
+
+echo "Cache misses measured with: $TOOL"
+printf "%-12s %-20s %12s %14s %12s %14s\n" "Trace" "Config" "split ms" "split misses" "joint ms" "joint misses"
+for g in $GHISTORY_BITS
+do
+  for f in $BINDIR/*.bpt
+  do
+    config="tournament:$g:$LOCAL_BITS"
+    read split_ms split_misses <<< "$(measure ./predictor_split --$config $f)"
+    read joint_ms joint_misses <<< "$(measure ./predictor --$config $f)"
+    printf "%-12s %-20s %12s %14s %12s %14s\n" "$(basename $f .bpt)" "$config" \
+           "$split_ms" "$split_misses" "$joint_ms" "$joint_misses"
+  done
+done
+
+rm -rf predictor_split $BINDIR
+make clean > /dev/null
@@ -2,84 +2,50 @@
 // Created by Hou Wang on 11/12/18.
 //
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "unitTest.h"
 #include "predictor.h"
+#include "helpers.h"
+#include "simd.h"
+#include "sample.h"
+#include "profile.h"
+#include "trace.h"
+#include "arena.h"
 
 /*
 * Unit Test for Helpers
 */
 
-// helper to create a mask for unsigned 32 bits
-uint32_t left_shift(int bits) {
-    if (bits < 0) return 0;
-
-    uint32_t res = 0;
-    for (int i = 0; i < bits; i++) {
-        res = (res << 1) | 1;
-    }
-    return res;
-}
-
-// compute 2 to the power of x
-uint32_t power(int exp) {
-    if (exp < 0) return 0;
-
-    uint32_t res = 1;
-    for (int i = 0; i < exp; i++) {
-        res = (res << 1);
-    }
-
-    return res;
-}
-
-// parse prediction entry to get the prediction
-uint8_t parse_prediction_entry(uint8_t entry) {
-    return (entry & 2) >> 1;
-}
-
-// compute next state for 2-bit counters based on current states
-uint8_t next_state(uint8_t curState, uint8_t outcome) {
-    if (curState == ST && outcome == TAKEN) {
-        return ST;
-    }
-
-    if (curState == SN && outcome == NOTTAKEN) {
-        return SN;
-    }
-
-    return (outcome == TAKEN) ? curState + 1 : curState - 1;
+// initialize 2-bit counters  to WN
+void init_counter(uint8_t *reg, uint32_t size) {
+    memset(reg, WN, size);
 }
 
-// get index using pc and ghr to global prediction buffer
-uint32_t xor_ghr_pc_to_index(uint32_t pc, uint32_t ghr, uint32_t mask) {
-    return (pc ^ ghr) & mask;
+// initialize a table to 0
+void init_table(uint32_t *table, uint32_t size) {
+    memset(table, NOTTAKEN, size * sizeof(uint32_t));
 }
 
-// get index based on ghr
-uint32_t hash_ghr_to_index(uint32_t ghr, uint32_t mask) {
-    return xor_ghr_pc_to_index(0, ghr, mask);
-}
+/**
+ * Packed Table Helpers
+ * */
+const char *layoutName[2] = {"byte", "packed"};
 
-// get index based on pc
-uint32_t hash_pc_to_index(uint32_t pc, uint32_t mask) {
-    return xor_ghr_pc_to_index(pc, 0, mask);
+uint32_t packed_counter_bytes(uint32_t entries) {
+    return (entries + 3) / 4;
 }
 
-// initialize 2-bit counters  to WN
-void init_counter(uint8_t *reg, uint32_t size) {
-    for (int i = 0; i < size; i++) {
-        reg[i] = WN;
-    }
+uint32_t packed_history_bytes(uint32_t entries, int width) {
+    return (uint32_t) (((uint64_t) entries * width + 7) / 8 + sizeof(uint64_t));
 }
 
-// initialize a table to 0
-void init_table(uint32_t *table, uint32_t size) {
-    for (uint32_t i = 0; i < size; i++) {
-        table[i] = NOTTAKEN;
-    }
+// WN in each of the four counters of a byte
+void init_packed_counter(uint8_t *table, uint32_t entries) {
+    memset(table, WN * 0x55, packed_counter_bytes(entries));
 }
 
 /**
@@ -98,21 +64,12 @@ int32_t sum(uint32_t size, uint32_t ghr, int32_t *percentronEntry) {
     return s;
 }
 
-// initialize perceptron table to 0, initialization does not affect result
-void init_perceptronTable(uint32_t ghrSize, int ghistoryBits, int32_t ***perceptronTable) {
-    *perceptronTable = (int32_t **) malloc(ghrSize * sizeof(int32_t * ));
-    for (int i = 0; i < ghrSize; i++) {
-        (*perceptronTable)[i] = (int *) malloc((ghistoryBits + 1) * sizeof(int32_t));
-        memset((*perceptronTable)[i], 0, sizeof(int32_t) * (ghistoryBits + 1));
-    }
-}
-
 uint8_t parse_perceptron_entry(uint32_t ghr, int ghistoryBits, int32_t *perceptronEntry) {
     int32_t s = sum(ghistoryBits, ghr, perceptronEntry);
     return (s >= 0) ? TAKEN : NOTTAKEN;
 }
 
-void train_perceptron(int ghistoryBits, uint32_t ghr, int32_t outcome, int32_t *perceptronEntry, int index) {
+void train_perceptron(int ghistoryBits, uint32_t ghr, int32_t outcome, int32_t *perceptronEntry, int32_t theta) {
     int32_t yout = sum(ghistoryBits, ghr, perceptronEntry);
     if ((yout * outcome) < 0 || abs(yout) <= theta) {
         perceptronEntry[0] += outcome;
@@ -124,6 +81,47 @@ void train_perceptron(int ghistoryBits, uint32_t ghr, int32_t outcome, int32_t *
 }
 
 
+/**
+ * Flat Perceptron Helpers
+ * */
+// initialize perceptron weights to 0, initialization does not affect result
+int8_t *init_perceptron_weights(uint32_t rows, uint32_t stride) {
+    void *weights = NULL;
+    if (posix_memalign(&weights, PERCEPTRON_ALIGN, (size_t) rows * stride) != 0) {
+        return NULL;
+    }
+    memset(weights, 0, (size_t) rows * stride);
+    return (int8_t *) weights;
+}
+
+void init_perceptron_history(uint64_t *xbits) {
+    memset(xbits, 0, PERCEPTRON_HISTORY_WORDS * sizeof(uint64_t));
+    xbits[0] = 1;
+}
+
+int32_t perceptron_output(const int8_t *weights, const uint64_t *xbits, int length) {
+    int32_t s = 0;
+    for (int i = 0; i < length; i++) {
+        int32_t w = weights[i];
+        s += ((xbits[i >> 6] >> (i & 63)) & 1) ? w : -w;
+    }
+    return s;
+}
+
+void perceptron_update(int8_t *weights, const uint64_t *xbits, int length, uint8_t outcome) {
+    for (int i = 0; i < length; i++) {
+        uint8_t x = (xbits[i >> 6] >> (i & 63)) & 1;
+        int32_t w = weights[i] + ((x == outcome) ? 1 : -1);
+        if (w > PERCEPTRON_WEIGHT_MAX) {
+            w = PERCEPTRON_WEIGHT_MAX;
+        } else if (w < PERCEPTRON_WEIGHT_MIN) {
+            w = PERCEPTRON_WEIGHT_MIN;
+        }
+        weights[i] = (int8_t) w;
+    }
+}
+
+
 /**
  * Unit Test Runner
  * Add unit tests here
@@ -212,6 +210,37 @@ void unit_test() {
     index = hash_pc_to_index(4, mask);
     assert_equal("hash_ghr_to_index", index, 4);
 
+    // packed counters and histories
+    uint8_t packed[4];
+    init_packed_counter(packed, 16);
+    assert_equal("get_counter", get_counter(packed, 5), WN);
+    set_counter(packed, 5, ST);
+    set_counter(packed, 6, SN);
+    assert_equal("set_counter", get_counter(packed, 5), ST);
+    assert_equal("set_counter", get_counter(packed, 6), SN);
+    assert_equal("set_counter", get_counter(packed, 4), WN);
+    assert_equal("set_counter", get_counter(packed, 7), WN);
+    uint8_t histories[16];
+    memset(histories, 0, sizeof(histories));
+    set_history(histories, 2, 10, 0x3ff);
+    set_history(histories, 3, 10, 0x155);
+    assert_equal("get_history", get_history(histories, 1, 10), 0);
+    assert_equal("get_history", get_history(histories, 2, 10), 0x3ff);
+    assert_equal("get_history", get_history(histories, 3, 10), 0x155);
+    set_history(histories, 2, 10, 0);
+    assert_equal("set_history", get_history(histories, 3, 10), 0x155);
+
+    // arena allocations are zeroed, cache line aligned and bounded
+    arena_t arena;
+    assert_equal("arena_init", arena_init(&arena, 3 * ARENA_HUGE_PAGE + 1, PAGES_TRANSPARENT), 1);
+    uint8_t *first = (uint8_t *) arena_alloc(&arena, 100);
+    uint8_t *second = (uint8_t *) arena_alloc(&arena, ARENA_HUGE_PAGE);
+    assert_equal("arena_alloc", second - first, 128);
+    assert_equal("arena_alloc alignment", (uintptr_t) second % ARENA_ALIGN, 0);
+    assert_equal("arena_alloc zeroed", second[ARENA_HUGE_PAGE - 1] == 0 && first[0] == 0, 1);
+    assert_equal("arena_alloc too large", arena_alloc(&arena, 3 * ARENA_HUGE_PAGE) == NULL, 1);
+    arena_release(&arena);
+
     // parse perceptron
     int32_t entry[] = {2, 1, 2, 3, 4};
     uint32_t g = 0b0000;
@@ -254,6 +283,343 @@ void unit_test() {
     bit = getBit(bits, 4);
     assert_equal("getBit", bit, PTAKEN);
 
+    // flat perceptron rows agree with the reference row helpers
+    int8_t row[] = {2, 1, -2, -3, -4};
+    uint64_t xbits[PERCEPTRON_HISTORY_WORDS];
+    init_perceptron_history(xbits);
+    s = perceptron_output(row, xbits, 5);
+    assert_equal("perceptron_output", s, sum(4, 0b0000, &entry2[0]));
+    perceptron_shift_history(xbits, 5, TAKEN);
+    perceptron_shift_history(xbits, 5, TAKEN);
+    perceptron_shift_history(xbits, 5, NOTTAKEN);
+    perceptron_shift_history(xbits, 5, NOTTAKEN);
+    assert_equal("perceptron_shift_history", xbits[0], 0b11001);
+    s = perceptron_output(row, xbits, 5);
+    assert_equal("perceptron_output", s, sum(4, 0b1100, &entry2[0]));
+    perceptron_shift_history(xbits, 5, TAKEN);
+    assert_equal("perceptron_shift_history", xbits[0], 0b10011);
+
+    // weights saturate symmetrically
+    int8_t sat[] = {126, -126};
+    uint64_t ones = 0b11;
+    perceptron_update(sat, &ones, 2, TAKEN);
+    perceptron_update(sat, &ones, 2, TAKEN);
+    assert_equal("perceptron_update", sat[0], 127);
+    perceptron_update(sat, &ones, 2, NOTTAKEN);
+    assert_equal("perceptron_update", sat[0], 126);
+    ones = 0b01;
+    perceptron_update(sat, &ones, 2, TAKEN);
+    perceptron_update(sat, &ones, 2, TAKEN);
+    perceptron_update(sat, &ones, 2, TAKEN);
+    assert_equal("perceptron_update", (uint32_t) (int32_t) sat[1], (uint32_t) -127);
+
+    // vectorized perceptron kernels agree with the scalar code
+    int lengths[] = {1, 14, 16, 17, 33, 64, 65, 200, PERCEPTRON_MAX_HISTORY + 1};
+    srand(240);
+    for (int level = SIMD_SSE2; level <= SIMD_AVX512; level++) {
+        if (!simd_select(level)) {
+            continue;
+        }
+        for (int l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            int length = lengths[l];
+            uint32_t stride = perceptron_stride(length);
+            int8_t *expect = init_perceptron_weights(1, stride);
+            int8_t *actual = init_perceptron_weights(1, stride);
+            int32_t wide[33];
+            for (int trial = 0; trial < 100; trial++) {
+                init_perceptron_history(xbits);
+                for (int i = 0; i < length; i++) {
+                    // favour the saturation limits
+                    int w = (rand() % 4 == 0) ? ((rand() & 1) ? 127 : -127) + rand() % 3 - 1
+                                              : rand() % 255 - 127;
+                    w = (w > 127) ? 127 : (w < -127) ? -127 : w;
+                    expect[i] = actual[i] = (int8_t) w;
+                    if (i < 33) {
+                        wide[i] = w;
+                    }
+                }
+                for (int i = 0; i < length; i++) {
+                    perceptron_shift_history(xbits, length, rand() & 1);
+                }
+
+                s = perceptron_dot(actual, xbits, length);
+                assert_equal(simdName[level], s, perceptron_output(expect, xbits, length));
+                if (length <= 33) {
+                    assert_equal(simdName[level], s, sum(length - 1, (uint32_t) (xbits[0] >> 1), wide));
+                }
+
+                uint8_t outcome = rand() & 1;
+                perceptron_update(expect, xbits, length, outcome);
+                perceptron_train(actual, xbits, length, outcome);
+                assert_equal(simdName[level], memcmp(expect, actual, stride), 0);
+            }
+            free(expect);
+            free(actual);
+        }
+    }
+    // simd_init() picks the best kernel the CPU supports
+    int best = SIMD_AVX512;
+    while (!simd_supported(best)) {
+        best--;
+    }
+    assert_equal("simd_init", simd_init(), best);
+    int32_t (*selected)(const int8_t *, const uint64_t *, int) = perceptron_dot;
+    simd_select(best);
+    assert_equal("simd_init kernel", selected == perceptron_dot, 1);
+
+    // specialized kernels match the generic loops
+    const char *specs[] = {"gshare:13", "tournament:9:10:10", "custom"};
+    uint32_t pcs[2048];
+    uint8_t outcomes[2048];
+    for (int i = 0; i < 2048; i++) {
+        pcs[i] = (uint32_t) rand() % 512 * 4;
+        outcomes[i] = (pcs[i] & 12) ? (rand() % 8 != 0) : (rand() & 1);
+    }
+    for (int k = 0; k < 3; k++) {
+        for (int packed = 0; packed <= 1; packed++) {
+            predictor_config_t config;
+            predictor_parse_config(specs[k], &config);
+            config.layout = packed;
+            predictor_t *special = predictor_create(&config);
+            config.generic = 1;
+            predictor_t *generic = predictor_create(&config);
+            assert_equal(specs[k], !strcmp(predictor_kernel_name(special), "specialized"), 1);
+            for (int round = 0; round < 4; round++) {
+                assert_equal(specs[k], predict_and_train(special, pcs, outcomes, 2048, NULL),
+                             predict_and_train(generic, pcs, outcomes, 2048, NULL));
+            }
+            predictor_destroy(special);
+            predictor_destroy(generic);
+        }
+
+        // the legacy two-call interface goes through the fused step
+        predictor_config_t config;
+        predictor_parse_config(specs[k], &config);
+        predictor_t *batch = predictor_create(&config);
+        bpType = config.bpType;
+        ghistoryBits = config.ghistoryBits;
+        lhistoryBits = config.lhistoryBits;
+        pcIndexBits = config.pcIndexBits;
+        theta = config.theta;
+        init_predictor();
+        uint32_t misses = 0;
+        for (int i = 0; i < 2048; i++) {
+            misses += make_prediction(pcs[i]) ^ outcomes[i];
+            train_predictor(pcs[i], outcomes[i]);
+        }
+        assert_equal(specs[k], misses, predict_and_train(batch, pcs, outcomes, 2048, NULL));
+        destructor();
+        predictor_destroy(batch);
+    }
+
+    // storage of the default configurations
+    const char *sized[] = {"static", "gshare:13", "tournament:9:10:10", "custom", "custom:13:7:29", "tage"};
+    const uint64_t sizes[] = {0, 16397, 14345, 917517, 14349, 123759};
+    for (int k = 0; k < 6; k++) {
+        predictor_config_t config;
+        predictor_parse_config(sized[k], &config);
+        assert_equal(sized[k], predictor_config_bits(&config), sizes[k]);
+    }
+
+    // widths the storage cannot be computed for are rejected
+    const char *unsized[] = {"gshare:-1", "gshare:0", "gshare:32", "tournament:9:33:10",
+                             "tournament:-1:10:10", "tournament:9:10:0", "custom:13:28:-5",
+                             "custom:13:31:29", "custom:0:13:29"};
+    for (int k = 0; k < 9; k++) {
+        predictor_config_t config;
+        assert_equal(unsized[k], predictor_parse_config(unsized[k], &config), 0);
+    }
+    predictor_config_t widest;
+    predictor_parse_config("gshare:30", &widest);
+    assert_equal("gshare:30", predictor_config_bits(&widest) == ((uint64_t) 2 << 30) + 30, 1);
+
+    // folded histories match folding the last 'length' bits directly
+    uint8_t bitsSeen[64];
+    folded_history_t fold;
+    fold.value = 0;
+    fold.width = 7;
+    fold.length = 23;
+    fold.outpoint = 23 % 7;
+    memset(bitsSeen, 0, sizeof(bitsSeen));
+    for (int i = 0; i < 40; i++) {
+        memmove(bitsSeen + 1, bitsSeen, sizeof(bitsSeen) - 1);
+        bitsSeen[0] = rand() & 1;
+        folded_history_update(&fold, bitsSeen[0], bitsSeen[23]);
+    }
+    uint32_t direct = 0;
+    for (int j = 0; j < 23; j++) {
+        direct ^= (uint32_t) bitsSeen[j] << (j % 7);
+    }
+    assert_equal("folded_history_update", fold.value, direct);
+    assert_equal("tage_history_length", tage_history_length(7, 4, 640, 0), 4);
+    assert_equal("tage_history_length", tage_history_length(7, 4, 640, 6), 640);
+
+    // sampling every branch reproduces the full run exactly
+    for (int k = 0; k < 3; k++) {
+        predictor_config_t config;
+        predictor_parse_config(specs[k], &config);
+        predictor_t *full = predictor_create(&config);
+        predictor_t *sampled = predictor_create(&config);
+        sample_config_t schedule;
+        sampler_t sampler;
+        sample_parse("256:256", &schedule);
+        sample_init(&sampler, &schedule);
+        sample_batch(&sampler, sampled, pcs, outcomes, 1000);
+        sample_batch(&sampler, sampled, pcs + 1000, outcomes + 1000, 1048);
+        double rate, halfWidth;
+        sample_estimate(&sampler, &rate, &halfWidth);
+        assert_equal(specs[k], sampler.mispredictions, predict_and_train(full, pcs, outcomes, 2048, NULL));
+        assert_equal("sample_estimate", halfWidth == 0, 1);
+
+        // a trace within the first period is measured in full too
+        predictor_t *first = predictor_create(&config);
+        sample_parse("4096:16", &schedule);
+        sample_init(&sampler, &schedule);
+        sample_batch(&sampler, first, pcs, outcomes, 2048);
+        sample_estimate(&sampler, &rate, &halfWidth);
+        assert_equal("sample first period", sampler.mispredictions, sampler.firstMisses);
+        assert_equal("sample first period", sampler.measured, 2048);
+        assert_equal("sample_estimate", halfWidth == 0, 1);
+        predictor_destroy(first);
+        predictor_destroy(full);
+        predictor_destroy(sampled);
+    }
+
+    // the profile counts every branch once, also across table growth
+    profile_t *profile = profile_create();
+    uint8_t misses[2048];
+    predictor_config_t gshare;
+    predictor_parse_config("gshare:13", &gshare);
+    predictor_t *profiled = predictor_create(&gshare);
+    uint32_t missed = predict_and_train(profiled, pcs, outcomes, 2048, misses);
+    profile_batch(profile, pcs, outcomes, misses, 2048);
+    for (uint32_t pc = 0; pc < 10000; pc++) {
+        profile_batch(profile, &pc, outcomes, misses, 1);
+    }
+    uint32_t executions = 0, mispredicted = 0, taken = 0, traceTaken = 0;
+    for (uint32_t pc = 0; pc < 512 * 4; pc += 4) {
+        const profile_entry_t *e = profile_find(profile, pc + 100000);
+        assert_equal("profile_find", e == NULL, 1);
+        e = profile_find(profile, pc);
+        executions += e->executions;
+        mispredicted += e->mispredictions;
+        taken += e->taken;
+    }
+    for (int i = 0; i < 2048; i++) {
+        traceTaken += outcomes[i];
+    }
+    // the PC loop adds branch 0's miss and outcome to each of the 512 PCs
+    assert_equal("profile executions", executions, 2048 + 512);
+    assert_equal("profile_size", profile_size(profile), 10000);
+    assert_equal("profile mispredictions", mispredicted, missed + 512 * misses[0]);
+    assert_equal("profile taken", taken, traceTaken + 512 * outcomes[0]);
+    predictor_destroy(profiled);
+    profile_destroy(profile);
+
+    // text traces: upper case, 8 and 9 digits, CRLF, malformed lines
+    // and a last line without a newline, over several newline windows
+    const char *textPath = "unit_test_trace.txt";
+    FILE *text = fopen(textPath, "w");
+    for (int i = 0; i < 100; i++) {
+        fprintf(text, "0x%x %d\n0XABCDEF%02X 1\r\nnot a branch\n0x1%08x  0\n\n", pcs[i], outcomes[i], i, pcs[i]);
+    }
+    fprintf(text, "0x7 1");
+    fclose(text);
+    trace_t *parsed = trace_open(textPath, 1);
+    uint32_t textPcs[512];
+    uint8_t textOutcomes[512];
+    size_t lines = trace_read_batch(parsed, textPcs, textOutcomes, 512);
+    int textOk = lines == 301 && textPcs[300] == 7 && textOutcomes[300] == 1;
+    for (int i = 0; i < 100 && textOk; i++) {
+        textOk = textPcs[3 * i] == pcs[i] && textOutcomes[3 * i] == outcomes[i] &&
+                 textPcs[3 * i + 1] == 0xabcdef00u + i && textOutcomes[3 * i + 1] == 1 &&
+                 textPcs[3 * i + 2] == pcs[i] && textOutcomes[3 * i + 2] == 0;
+    }
+    trace_stats_t textStats;
+    trace_stats(parsed, &textStats);
+    assert_equal("trace_read_batch", textOk, 1);
+    assert_equal("trace malformed lines", textStats.malformed, 200);
+    trace_close(parsed);
+
+    // a seekable copy read from the middle of its third frame
+    const char *seekPath = "unit_test_trace.bps";
+    parsed = trace_open(textPath, 1);
+    assert_equal("trace_convert_seekable", trace_convert_seekable(parsed, seekPath, 128), 301);
+    trace_close(parsed);
+    parsed = trace_open(seekPath, 2);
+    assert_equal("trace_seek", trace_seek(parsed, 270), 1);
+    lines = trace_read_batch(parsed, textPcs + 301, textOutcomes + 301, 64);
+    int seekOk = lines == 31;
+    for (size_t i = 0; i < lines && seekOk; i++) {
+        seekOk = textPcs[301 + i] == textPcs[270 + i] && textOutcomes[301 + i] == textOutcomes[270 + i];
+    }
+    assert_equal("seekable trace", seekOk, 1);
+    assert_equal("trace_seek past the end", trace_seek(parsed, 302), 0);
+    trace_close(parsed);
+
+    // a binary copy with one flipped PC bit fails its checksum
+    const char *binaryPath = "unit_test_trace.bpt";
+    parsed = trace_open(textPath, 1);
+    assert_equal("trace_convert", trace_convert(parsed, binaryPath), 301);
+    trace_close(parsed);
+    parsed = trace_open(binaryPath, 1);
+    lines = trace_read_batch(parsed, textPcs + 301, textOutcomes + 301, 211);
+    assert_equal("intact binary trace", trace_error(parsed), 0);
+    trace_close(parsed);
+    FILE *damaged = fopen(binaryPath, "r+b");
+    fseek(damaged, sizeof(trace_header_t) + TRACE_BLOCK_BYTES + 5, SEEK_SET);
+    putc(getc(damaged) ^ 0x10, damaged);
+    fclose(damaged);
+    parsed = trace_open(binaryPath, 1);
+    while (trace_read_batch(parsed, textPcs + 301, textOutcomes + 301, 211) > 0) {
+    }
+    assert_equal("damaged binary trace", trace_error(parsed), 1);
+    trace_close(parsed);
+
+    // a dictionary copy gives back every PC and an ID that maps to it
+    const char *dictPath = "unit_test_trace.bpd";
+    parsed = trace_open(textPath, 1);
+    assert_equal("trace_convert_dictionary", trace_convert_dictionary(parsed, dictPath), 301);
+    trace_close(parsed);
+    parsed = trace_open(dictPath, 1);
+    uint32_t dictPcs[512];
+    uint32_t dictIds[512];
+    uint8_t dictOutcomes[512];
+    lines = trace_read_ids(parsed, dictPcs, dictIds, dictOutcomes, 512);
+    const uint32_t *dictionary;
+    uint32_t dictSize = trace_dictionary(parsed, &dictionary);
+    int dictOk = lines == 301;
+    for (size_t i = 0; i < lines && dictOk; i++) {
+        dictOk = dictPcs[i] == textPcs[i] && dictOutcomes[i] == textOutcomes[i] &&
+                 dictIds[i] < dictSize && dictionary[dictIds[i]] == dictPcs[i];
+    }
+    assert_equal("dictionary trace", dictOk, 1);
+    assert_equal("intact dictionary trace", trace_error(parsed), 0);
+
+    // profiled by dictionary ID, every PC gets the counts it gets by PC
+    profile_t *byPc = profile_create();
+    profile_t *byId = profile_create();
+    profiled = predictor_create(&gshare);
+    predict_and_train(profiled, dictPcs, dictOutcomes, lines, misses);
+    profile_batch(byPc, dictPcs, dictOutcomes, misses, lines);
+    profile_batch_ids(byId, dictIds, dictPcs, dictOutcomes, misses, lines);
+    int profileOk = profile_size(byPc) == dictSize && profile_size(byId) == dictSize;
+    for (uint32_t id = 0; id < dictSize && profileOk; id++) {
+        const profile_entry_t *a = profile_find(byPc, dictionary[id]);
+        const profile_entry_t *b = profile_find(byId, dictionary[id]);
+        profileOk = a != NULL && b != NULL && a->executions == b->executions &&
+                    a->mispredictions == b->mispredictions && a->taken == b->taken;
+    }
+    assert_equal("profile_batch_ids", profileOk, 1);
+    predictor_destroy(profiled);
+    profile_destroy(byPc);
+    profile_destroy(byId);
+    trace_close(parsed);
+    remove(textPath);
+    remove(seekPath);
+    remove(binaryPath);
+    remove(dictPath);
+
     // terminate if unit tests failed
     if (failedCounter > 0) {
         printf("Unit Tests Failed: %d tests fail", failedCounter);
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include "predictor.h"
 
 /**
  * Helpers for Gshare and Tournament
@@ -15,26 +17,63 @@
 // unit tests for all helper functions
 void unit_test();
 
+// The per-branch helpers below are inline so the predictor loops can
+// fold them, including constant masks in the specialized kernels
+
+// hint that the cache line at 'addr' will be read soon
+#ifdef __GNUC__
+#define prefetch(addr) __builtin_prefetch(addr)
+#else
+#define prefetch(addr) ((void) 0)
+#endif
+
 // helper to create a mask for unsigned 32 bits
-uint32_t left_shift(int bits);
+static inline uint32_t left_shift(int bits) {
+    if (bits < 0) return 0;
+    if (bits >= 32) return UINT32_MAX;
+
+    return ((uint32_t) 1 << bits) - 1;
+}
 
 // compute 2 to the power of x
-uint32_t power(int exp);
+static inline uint32_t power(int exp) {
+    if (exp < 0 || exp >= 32) return 0;
+
+    return (uint32_t) 1 << exp;
+}
 
 // parse prediction entry to get the prediction
-uint8_t parse_prediction_entry(uint8_t entry);
+static inline uint8_t parse_prediction_entry(uint8_t entry) {
+    return (entry & 2) >> 1;
+}
 
 // compute next state for 2-bit counters based on current states
-uint8_t next_state(uint8_t curState, uint8_t outcome);
+static inline uint8_t next_state(uint8_t curState, uint8_t outcome) {
+    if (curState == ST && outcome == TAKEN) {
+        return ST;
+    }
+
+    if (curState == SN && outcome == NOTTAKEN) {
+        return SN;
+    }
+
+    return (outcome == TAKEN) ? curState + 1 : curState - 1;
+}
 
 // get index using pc and ghr to global prediction buffer
-uint32_t xor_ghr_pc_to_index(uint32_t pc, uint32_t ghr, uint32_t mask);
+static inline uint32_t xor_ghr_pc_to_index(uint32_t pc, uint32_t ghr, uint32_t mask) {
+    return (pc ^ ghr) & mask;
+}
 
 // get index based on ghr
-uint32_t hash_ghr_to_index(uint32_t ghr, uint32_t mask);
+static inline uint32_t hash_ghr_to_index(uint32_t ghr, uint32_t mask) {
+    return xor_ghr_pc_to_index(0, ghr, mask);
+}
 
 // get index based on pc
-uint32_t hash_pc_to_index(uint32_t pc, uint32_t mask);
+static inline uint32_t hash_pc_to_index(uint32_t pc, uint32_t mask) {
+    return xor_ghr_pc_to_index(pc, 0, mask);
+}
 
 // initialize 2-bit counters  to WN
 void init_counter(uint8_t* reg, uint32_t size);
@@ -42,13 +81,103 @@ void init_counter(uint8_t* reg, uint32_t size);
 // initialize a table to 0
 void init_table(uint32_t* table, uint32_t size);
 
+/**
+ * Packed Table Helpers
+ * 2-bit counters are packed four per byte, counter i sits in bits
+ * 2*(i%4) and 2*(i%4)+1 of byte i/4.
+ * Local histories are packed to 'width' <= 32 bits each, entry i starts at
+ * bit i*width. History tables have 8 bytes of slack so every entry can be
+ * read with one unaligned 64-bit load.
+ * */
+#define LAYOUT_BYTE    0   // one counter per uint8_t, one history per uint32_t
+#define LAYOUT_PACKED  1   // four counters per byte, histories at their real width
+extern const char *layoutName[];
+
+static inline uint8_t get_counter(const uint8_t *table, uint32_t index) {
+    return (table[index >> 2] >> ((index & 3) << 1)) & 3;
+}
+
+static inline void set_counter(uint8_t *table, uint32_t index, uint8_t value) {
+    int shift = (index & 3) << 1;
+    table[index >> 2] = (uint8_t) ((table[index >> 2] & ~(3 << shift)) | (value << shift));
+}
+
+static inline uint32_t get_history(const uint8_t *table, uint32_t index, int width) {
+    uint64_t bit = (uint64_t) index * width;
+    uint64_t word;
+    memcpy(&word, table + (bit >> 3), sizeof(word));
+    return (uint32_t) ((word >> (bit & 7)) & (((uint64_t) 1 << width) - 1));
+}
+
+static inline void set_history(uint8_t *table, uint32_t index, int width, uint32_t value) {
+    uint64_t bit = (uint64_t) index * width;
+    uint64_t mask = (((uint64_t) 1 << width) - 1) << (bit & 7);
+    uint64_t word;
+    memcpy(&word, table + (bit >> 3), sizeof(word));
+    word = (word & ~mask) | (((uint64_t) value << (bit & 7)) & mask);
+    memcpy(table + (bit >> 3), &word, sizeof(word));
+}
+
+// bytes used by 'entries' packed counters or histories
+uint32_t packed_counter_bytes(uint32_t entries);
+uint32_t packed_history_bytes(uint32_t entries, int width);
+
+// initialize packed 2-bit counters to WN
+void init_packed_counter(uint8_t *table, uint32_t entries);
+
 /**
  * Perceptrons Helpers
+ * Reference versions working on one int32_t row, used by the unit tests
  * */
-void init_perceptronTable(uint32_t ghrSize, int ghistoryBits, int32_t ***perceptronTable);
 uint8_t parse_perceptron_entry(uint32_t ghr, int ghistoryBits, int32_t perceptronEntry[ghistoryBits]);
-int32_t getBit(uint32_t ghr, uint32_t index);
-void train_perceptron(int ghistoryBits, uint32_t ghr, int32_t outcome, int32_t *perceptronEntry, int index);
+int32_t getBit(uint32_t ghr, int index);
+void train_perceptron(int ghistoryBits, uint32_t ghr, int32_t outcome, int32_t *perceptronEntry, int32_t theta);
 int32_t sum(uint32_t size, uint32_t ghr, int32_t *percentronEntry);
 
+/**
+ * Flat Perceptron Helpers
+ * All rows live in one 64-byte aligned matrix of saturating 8-bit weights.
+ * A row holds 'length' = history + 1 weights, weight 0 is the bias.
+ * The history is kept as input bits 'xbits': bit 0 is always 1 (bias input),
+ * bit i is the outcome of the i-th most recent branch.
+ * */
+#define PERCEPTRON_MAX_HISTORY 1023
+#define PERCEPTRON_HISTORY_WORDS ((PERCEPTRON_MAX_HISTORY + 1) / 64)
+#define PERCEPTRON_WEIGHT_MAX 127
+#define PERCEPTRON_WEIGHT_MIN (-127)
+#define PERCEPTRON_WEIGHT_BITS 8
+#define PERCEPTRON_ALIGN 64
+
+// bytes per row, 'length' rounded up to whole cache lines
+static inline uint32_t perceptron_stride(int length) {
+    return (length + PERCEPTRON_ALIGN - 1) / PERCEPTRON_ALIGN * PERCEPTRON_ALIGN;
+}
+
+// allocate 'rows' zeroed rows of 'stride' bytes, free with free()
+int8_t *init_perceptron_weights(uint32_t rows, uint32_t stride);
+
+// reset the input bits to an all NOTTAKEN history
+void init_perceptron_history(uint64_t *xbits);
+
+// dot product of a row with the +1/-1 inputs
+int32_t perceptron_output(const int8_t *weights, const uint64_t *xbits, int length);
+
+// move every weight of a row one step towards agreeing with 'outcome'
+void perceptron_update(int8_t *weights, const uint64_t *xbits, int length, uint8_t outcome);
+
+// shift 'outcome' into the history part of the input bits
+static inline void perceptron_shift_history(uint64_t *xbits, int length, uint8_t outcome) {
+    int words = (length + 63) >> 6;
+    for (int i = words - 1; i > 0; i--) {
+        xbits[i] = (xbits[i] << 1) | (xbits[i - 1] >> 63);
+    }
+    // drop the bias bit, shift in the outcome as bit 1, then restore the bias
+    xbits[0] = ((xbits[0] & ~(uint64_t) 1) << 1) | ((uint64_t) outcome << 1) | 1;
+
+    // clear the bits past the history length
+    if (length & 63) {
+        xbits[words - 1] &= ((uint64_t) 1 << (length & 63)) - 1;
+    }
+}
+
 #endif //CSE240A_HELPERS_H
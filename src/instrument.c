@@ -0,0 +1,188 @@
+//========================================================//
+//  instrument.c                                          //
+//  Source file for the table instrumentation             //
+//                                                        //
+//  Distinct PCs per index come from a hash set of every  //
+//  (index, pc) pair seen, counted per index when the     //
+//  report is printed.                                    //
+//========================================================//
+
+#include <stdlib.h>
+#include "instrument.h"
+
+// Buckets of the PCs per index histogram: 1, 2, 3-4, 5-8, 9+
+#define PC_BUCKETS 5
+
+static const char *bucketName[PC_BUCKETS] = {"1", "2", "3-4", "5-8", "9+"};
+static const char *stateName[4] = {"SN", "WN", "WT", "ST"};
+
+instrument_t *
+instrument_create(void) {
+    return (instrument_t *) calloc(1, sizeof(instrument_t));
+}
+
+// Add a table
+//
+// Returns the statistics of the new table
+//
+table_stats_t *
+instrument_table(instrument_t *inst, const char *name, uint32_t entries, int counters) {
+    table_stats_t *t = &inst->tables[inst->count++];
+    t->name = name;
+    t->entries = entries;
+    t->counters = counters;
+    t->lastPc = (uint32_t *) calloc(entries, sizeof(uint32_t));
+    t->written = (uint8_t *) calloc(entries, 1);
+    t->pairMask = (1u << 12) - 1;
+    t->pairs = (uint64_t *) calloc(t->pairMask + 1, sizeof(uint64_t));
+    return t;
+}
+
+static inline uint32_t
+pair_slot(uint64_t key, uint32_t mask) {
+    return (uint32_t) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+// add 'key' to the pair set, doubling it at half load
+static void
+add_pair(table_stats_t *t, uint64_t key) {
+    uint32_t slot = pair_slot(key, t->pairMask);
+    while (t->pairs[slot] != 0) {
+        if (t->pairs[slot] == key) {
+            return;
+        }
+        slot = (slot + 1) & t->pairMask;
+    }
+    t->pairs[slot] = key;
+
+    if (2 * ++t->numPairs > t->pairMask + 1) {
+        uint64_t *old = t->pairs;
+        uint32_t oldSize = t->pairMask + 1;
+        t->pairMask = 2 * oldSize - 1;
+        t->pairs = (uint64_t *) calloc(t->pairMask + 1, sizeof(uint64_t));
+        for (uint32_t k = 0; k < oldSize; k++) {
+            if (old[k] != 0) {
+                slot = pair_slot(old[k], t->pairMask);
+                while (t->pairs[slot] != 0) {
+                    slot = (slot + 1) & t->pairMask;
+                }
+                t->pairs[slot] = old[k];
+            }
+        }
+        free(old);
+    }
+}
+
+// Record a read of entry 'index' for the branch at 'pc'
+//
+void
+instrument_read(table_stats_t *t, uint32_t index, uint32_t pc, uint8_t state) {
+    t->reads++;
+    if (t->counters) {
+        t->states[state & 3]++;
+    }
+    // the index is stored plus one so no pair is 0
+    add_pair(t, ((uint64_t) (index + 1) << 32) | pc);
+}
+
+// Record a write of entry 'index' for the branch at 'pc'
+//
+void
+instrument_write(table_stats_t *t, uint32_t index, uint32_t pc) {
+    t->writes++;
+    if (t->written[index] && t->lastPc[index] != pc) {
+        t->conflicts++;
+    }
+    t->written[index] = 1;
+    t->lastPc[index] = pc;
+}
+
+// Record a tournament selector decision
+//
+void
+instrument_choice(instrument_t *inst, int local, int localRight, int globalRight) {
+    if (local) {
+        inst->chooseLocal++;
+        inst->localRight += localRight;
+    } else {
+        inst->chooseGlobal++;
+        inst->globalRight += globalRight;
+    }
+    inst->bothRight += localRight && globalRight;
+    inst->bothWrong += !localRight && !globalRight;
+}
+
+static double
+percent(uint64_t part, uint64_t whole) {
+    return (whole > 0) ? 100.0 * part / whole : 0;
+}
+
+static int
+bucket_of(uint32_t pcs) {
+    return (pcs <= 2) ? pcs - 1 : (pcs <= 4) ? 2 : (pcs <= 8) ? 3 : 4;
+}
+
+static void
+report_table(const table_stats_t *t, FILE *out) {
+    // distinct pcs of every index
+    uint32_t *pcs = (uint32_t *) calloc(t->entries, sizeof(uint32_t));
+    for (uint32_t k = 0; k <= t->pairMask; k++) {
+        if (t->pairs[k] != 0) {
+            pcs[(t->pairs[k] >> 32) - 1]++;
+        }
+    }
+    uint32_t used = 0;
+    uint64_t buckets[PC_BUCKETS] = {0};
+    for (uint32_t i = 0; i < t->entries; i++) {
+        if (pcs[i] > 0) {
+            used++;
+            buckets[bucket_of(pcs[i])]++;
+        }
+    }
+    free(pcs);
+
+    fprintf(out, "  %s: %u entries, %.1f%% used, %.1f%% of %llu writes by another pc\n", t->name,
+            t->entries, percent(used, t->entries), percent(t->conflicts, t->writes),
+            (unsigned long long) t->writes);
+    fprintf(out, "    pcs per used index:");
+    for (int b = 0; b < PC_BUCKETS; b++) {
+        fprintf(out, "  %s %.1f%%", bucketName[b], percent(buckets[b], used));
+    }
+    fprintf(out, "\n");
+    if (t->counters) {
+        fprintf(out, "    counter states read:");
+        for (int s = 0; s < 4; s++) {
+            fprintf(out, "  %s %.1f%%", stateName[s], percent(t->states[s], t->reads));
+        }
+        fprintf(out, "\n");
+    }
+}
+
+// Print a compact report of every table
+//
+void
+instrument_report(const instrument_t *inst, FILE *out, const char *name) {
+    fprintf(out, "Instrumentation of %s\n", name);
+    for (int k = 0; k < inst->count; k++) {
+        report_table(&inst->tables[k], out);
+    }
+
+    uint64_t choices = inst->chooseLocal + inst->chooseGlobal;
+    if (choices > 0) {
+        fprintf(out, "  selector: local %.1f%% (right %.1f%%), global %.1f%% (right %.1f%%),"
+                     " both right %.1f%%, both wrong %.1f%%\n",
+                percent(inst->chooseLocal, choices), percent(inst->localRight, inst->chooseLocal),
+                percent(inst->chooseGlobal, choices), percent(inst->globalRight, inst->chooseGlobal),
+                percent(inst->bothRight, choices), percent(inst->bothWrong, choices));
+    }
+}
+
+void
+instrument_destroy(instrument_t *inst) {
+    for (int k = 0; k < inst->count; k++) {
+        free(inst->tables[k].lastPc);
+        free(inst->tables[k].written);
+        free(inst->tables[k].pairs);
+    }
+    free(inst);
+}
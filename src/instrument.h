@@ -0,0 +1,81 @@
+//========================================================//
+//  instrument.h                                          //
+//  Header file for the table instrumentation             //
+//                                                        //
+//  Per table: how many distinct PCs use each index, how  //
+//  often an entry is written by another PC than the last //
+//  writer, occupancy and a histogram of the 2-bit        //
+//  counter states read. For the tournament predictor     //
+//  also the selector choices. The predictors only call   //
+//  into this when built with -DINSTRUMENT.               //
+//========================================================//
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define INSTRUMENT_MAX_TABLES 4
+
+// Statistics of one table
+typedef struct {
+    const char *name;
+    uint32_t entries;
+    uint32_t *lastPc;           // pc of the last write to each entry
+    uint8_t *written;           // the entry was written at least once
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t conflicts;         // writes by another pc than the last one
+    uint64_t states[4];         // 2-bit counter values read, SN to ST
+    int counters;               // the entries are 2-bit counters
+
+    // distinct (index, pc) pairs, open addressing, key 0 is empty
+    uint64_t *pairs;
+    uint32_t pairMask;
+    uint32_t numPairs;
+} table_stats_t;
+
+// Statistics of one predictor instance
+typedef struct {
+    int count;
+    table_stats_t tables[INSTRUMENT_MAX_TABLES];
+
+    // tournament selector
+    uint64_t chooseLocal;
+    uint64_t chooseGlobal;
+    uint64_t localRight;        // when the local prediction was chosen
+    uint64_t globalRight;       // when the global prediction was chosen
+    uint64_t bothRight;
+    uint64_t bothWrong;
+} instrument_t;
+
+instrument_t *instrument_create(void);
+
+// Add a table of 'entries' entries, 'counters' if they are 2-bit
+// counters whose states should be recorded
+//
+// Returns the statistics of the new table
+//
+table_stats_t *instrument_table(instrument_t *inst, const char *name, uint32_t entries, int counters);
+
+// Record a read of entry 'index' holding 'state' for the branch at
+// 'pc', 'state' is ignored unless the table holds counters
+//
+void instrument_read(table_stats_t *t, uint32_t index, uint32_t pc, uint8_t state);
+
+// Record a write of entry 'index' for the branch at 'pc'
+//
+void instrument_write(table_stats_t *t, uint32_t index, uint32_t pc);
+
+// Record a tournament selector decision and which components were right
+//
+void instrument_choice(instrument_t *inst, int local, int localRight, int globalRight);
+
+// Print a compact report of every table, 'name' is the configuration
+//
+void instrument_report(const instrument_t *inst, FILE *out, const char *name);
+
+void instrument_destroy(instrument_t *inst);
+
+#endif
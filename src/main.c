@@ -9,12 +9,83 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "predictor.h"
 #include "helpers.h"
+#include "predlog.h"
+#include "profile.h"
+#include "sample.h"
+#include "seekable.h"
+#include "arena.h"
+#include "trace.h"
+#include "simd.h"
+#include "sweep.h"
+#include "tune.h"
 
-FILE *stream;
-char *buf = NULL;
-size_t len = 0;
+trace_t *trace;
+char *tracePath = NULL;   // trace file, stdin if NULL
+char *convertPath = NULL; // write the trace in binary format to this file
+uint32_t convertFrame = 0; // branches per frame of a seekable trace, 0 for plain binary
+int convertDictionary = 0; // write a PC dictionary trace instead
+uint64_t traceStart = 0;  // first branch simulated
+uint64_t traceBranches = 0; // branches simulated, 0 for the rest of the trace
+int threads;              // worker threads for decompression and sweeps
+int simdLevel;            // perceptron kernel, see simd.h
+int layout = DEFAULT_LAYOUT; // counter table layout, see helpers.h
+int generic = 0;          // never use the specialized kernels
+int pages = PAGES_TRANSPARENT; // page policy of the predictor tables, see arena.h
+int parseStats = 0;       // print the text parsing throughput on stderr
+
+// Predictor configurations evaluated on the trace, each branch is
+// decoded once and fed to one predictor instance per configuration
+predictor_config_t *configs = NULL;
+int numConfigs = 0;
+int configCap = 0;
+
+// Traces of a sweep, every trace is simulated with every configuration
+int sweep = 0;
+char **sweepTraces = NULL;
+int numTraces = 0;
+int traceCap = 0;
+
+// Auto-tune for this many bits of storage over the traces of the sweep
+uint64_t tuneBudget = 0;
+uint32_t tunePrefix = 200000; // branches per trace used for pruning
+
+// Reject predictors that need more storage than this, 0 for no limit
+uint64_t maxBits = 0;
+int printStorage = 0;     // print the storage of each predictor and exit
+
+// Measure only sampled intervals of the trace, see sample.h
+int sampling = 0;
+sample_config_t sampleConfig;
+
+// Split the trace into this many chunks simulated in parallel, each
+// trained first on the last chunkWarmup branches of the one before
+int chunks = 0;
+uint32_t chunkWarmup = 100000;
+int chunkCheck = 0;       // also run the whole trace sequentially and compare
+
+// Count executions and mispredictions of every static branch and print
+// the profileTop worst, or write them all to profilePath as CSV
+int profileTop = 0;
+char *profilePath = NULL;
+
+// Log every prediction (--verbose is a text log on stdout)
+char *logPath = NULL;
+int logFormat = PREDLOG_TEXT;
+int logMisses = 0;        // log only the mispredictions
+
+// Print the statistics of every 'interval' branches to intervalPath
+// (stderr if NULL) as a tab separated table
+uint64_t interval = 0;
+char *intervalPath = NULL;
+
+// Print the table statistics of a build with -DINSTRUMENT to this file
+char *instrumentPath = NULL;
+
+// Branches are read and simulated in batches of this size
+#define BATCH_SIZE 4096
 
 // Print out the Usage information to stderr
 //
@@ -22,14 +93,319 @@ void
 usage() {
     fprintf(stderr, "Usage: predictor <options> [<trace>]\n");
     fprintf(stderr, "       bunzip -kc trace.bz2 | predictor <options>\n");
+    fprintf(stderr, "       predictor <options> trace.bz2\n");
     fprintf(stderr, " Options:\n");
     fprintf(stderr, " --help       Print this message\n");
+    fprintf(stderr, " --test       Run the unit tests\n");
     fprintf(stderr, " --verbose    Print predictions on stdout\n");
-    fprintf(stderr, " --<type>     Branch prediction scheme:\n");
+    fprintf(stderr, " --log:<format>:<file>  Log every prediction to <file> (- for stdout) as\n"
+                    "                   text, csv or binary (see predlog.h)\n");
+    fprintf(stderr, " --log-misses      Log only the mispredictions\n");
+    fprintf(stderr, " --interval:<n>[:<file>]  Print the statistics of every <n> branches to\n"
+                    "                   <file> (stderr) as a tab separated table\n");
+    fprintf(stderr, " --convert:<file>  Write the trace to <file> in binary format\n");
+    fprintf(stderr, " --seekable[:<n>]  With --convert, write a seekable trace of zlib frames of\n"
+                    "                   <n> branches (65536) that can be read from any branch\n");
+    fprintf(stderr, " --dictionary      With --convert, write a PC dictionary and one varint per\n"
+                    "                   branch, about 2 bytes per branch\n");
+    fprintf(stderr, " --start:<n>       Start simulating (or converting) at branch <n>\n");
+    fprintf(stderr, " --branches:<n>    Simulate only <n> branches\n");
+    fprintf(stderr, " --parse-stats     Print the text trace parsing throughput on stderr\n");
+    fprintf(stderr, " --threads:<n>     Worker threads for bzip2 traces and sweeps\n");
+    fprintf(stderr, " --sweep[:<file>]  Simulate every trace given (and listed in <file>) with\n"
+                    "                   every predictor, print one tab separated table\n");
+    fprintf(stderr, " --tune:<bits>[:<prefix>]  Search the predictors that fit in <bits> on the\n"
+                    "                   given traces, prune on the first <prefix> branches of\n"
+                    "                   each and print the rate vs. storage Pareto frontier\n");
+    fprintf(stderr, " --sample:<period>:<interval>[:<warmup>]  Measure the first <period> branches,\n"
+                    "                   then <interval> branches at a random place in every\n"
+                    "                   <period>, and estimate the misprediction rate with a 95%%\n"
+                    "                   confidence interval. The other branches train the tables,\n"
+                    "                   or with <warmup> only that many before each interval do,\n"
+                    "                   the rest just update the histories and the interval then\n"
+                    "                   covers the sampling error only, not the colder tables\n");
+    fprintf(stderr, " --chunks:<k>[:<warmup>]  Split the trace into <k> chunks simulated in parallel,\n"
+                    "                   each trained first on the last <warmup> branches (100000)\n"
+                    "                   of the chunk before\n");
+    fprintf(stderr, " --chunk-check     With --chunks, also simulate the trace sequentially and print\n"
+                    "                   the difference\n");
+    fprintf(stderr, " --profile[:<n>]   Print the <n> branches (20) with the most mispredictions\n");
+    fprintf(stderr, " --profile-csv:<file>  Write the counts of every branch to <file> as CSV\n");
+    fprintf(stderr, " --instrument[:<file>]  Print table aliasing and counter states (stdout),\n"
+                    "                   needs a build with -DINSTRUMENT\n");
+    fprintf(stderr, " --simd:<kernel>   Perceptron kernel: scalar, sse2, avx2 or avx512\n");
+    fprintf(stderr, " --layout:<type>   Counter tables: byte (one per byte) or packed (four per byte)\n");
+    fprintf(stderr, " --generic         Run the generic loops even for configurations in kernels.def\n");
+    fprintf(stderr, " --pages:<type>    Pages of tables over 2 MB: transparent (huge pages if the\n"
+                    "                   kernel allows), huge (reserved huge pages) or small\n");
+    fprintf(stderr, " --max-bits:<n>    Reject predictors that need more than <n> bits of storage\n");
+    fprintf(stderr, " --storage         Print the storage of every table of the predictors\n");
+    fprintf(stderr, " --configs:<file>  Read one predictor type per line from <file>\n");
+    fprintf(stderr, " --<type>     Branch prediction scheme, repeat to evaluate\n"
+                    "              several predictors in one pass:\n");
     fprintf(stderr, "    static\n"
                     "    gshare:<# ghistory>\n"
                     "    tournament:<# ghistory>:<# lhistory>:<# index>\n"
-                    "    custom\n");
+                    "    custom[:<# history>:<# index>:<theta>]\n"
+                    "    tage[:<# tables>:<# index>:<# tag>:<min history>:<max history>]\n");
+}
+
+// Add a predictor configuration from a spec such as "gshare:13"
+//
+// Returns True if Successful
+//
+int
+add_config(const char *spec) {
+    predictor_config_t config;
+    if (!predictor_parse_config(spec, &config)) {
+        return 0;
+    }
+
+    if (numConfigs == configCap) {
+        configCap = (configCap == 0) ? 4 : 2 * configCap;
+        configs = (predictor_config_t *) realloc(configs, configCap * sizeof(predictor_config_t));
+    }
+    configs[numConfigs++] = config;
+
+    // the globals describe the last configuration given
+    bpType = config.bpType;
+    ghistoryBits = config.ghistoryBits;
+    lhistoryBits = config.lhistoryBits;
+    pcIndexBits = config.pcIndexBits;
+    theta = config.theta;
+    return 1;
+}
+
+// Add every configuration listed in 'path', one spec per line with
+// or without the leading "--". Blank lines and '#' comments are skipped
+//
+// Returns True if Successful
+//
+int
+read_configs(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    int ok = 1;
+    while (ok && getline(&line, &cap, file) != -1) {
+        char *spec = line + strspn(line, " \t");
+        spec[strcspn(spec, " \t\r\n#")] = '\0';
+        if (!strncmp(spec, "--", 2)) {
+            spec += 2;
+        }
+        if (*spec != '\0' && !add_config(spec)) {
+            fprintf(stderr, "Bad predictor type %s in %s\n", spec, path);
+            ok = 0;
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return ok;
+}
+
+// Add a trace to the sweep
+//
+void
+add_trace(const char *path) {
+    if (numTraces == traceCap) {
+        traceCap = (traceCap == 0) ? 8 : 2 * traceCap;
+        sweepTraces = (char **) realloc(sweepTraces, traceCap * sizeof(char *));
+    }
+    sweepTraces[numTraces++] = strdup(path);
+}
+
+// Add every trace listed in 'path', one file per line. Blank lines and
+// '#' comments are skipped
+//
+// Returns True if Successful
+//
+int
+read_traces(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, file) != -1) {
+        char *trace = line + strspn(line, " \t");
+        trace[strcspn(trace, "\r\n#")] = '\0';
+        trace[strcspn(trace, " \t")] = '\0';
+        if (*trace != '\0') {
+            add_trace(trace);
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return 1;
+}
+
+// Simulate every trace with every configuration on 'threads' threads
+// and print the results table
+//
+// Returns True if every trace could be opened
+//
+int
+run_sweep() {
+    int n = numTraces * numConfigs;
+    sweep_job_t *jobs = (sweep_job_t *) calloc(n, sizeof(sweep_job_t));
+    for (int t = 0; t < numTraces; t++) {
+        for (int c = 0; c < numConfigs; c++) {
+            jobs[t * numConfigs + c].trace = sweepTraces[t];
+            jobs[t * numConfigs + c].config = configs[c];
+        }
+    }
+
+    sweep_run(jobs, n, threads);
+    sweep_print(stdout, jobs, n);
+    fflush(stdout);
+
+    int ok = 1;
+    for (int i = 0; i < n; i++) {
+        if (jobs[i].failed) {
+            fprintf(stderr, "Cannot read trace %s\n", jobs[i].trace);
+            ok = 0;
+        }
+    }
+    free(jobs);
+    return ok;
+}
+
+// Simulate the trace in 'chunks' parallel jobs per configuration,
+// merge their counts and print them like a sequential run
+//
+// Returns True if the trace could be opened and read whole
+//
+int
+run_chunks() {
+    trace_t *trace = trace_open(tracePath, threads);
+    if (trace == NULL) {
+        return 0;
+    }
+    // seekable traces are read by every job from its chunk on, others
+    // are loaded once and shared
+    uint32_t *pcs = NULL;
+    uint8_t *outcomes = NULL;
+    int64_t length = (tracePath != NULL) ? trace_length(trace) : -1;
+    uint64_t count;
+    if (length >= chunks) {
+        count = (uint64_t) length;
+    } else {
+        count = (uint64_t) trace_load(trace, &pcs, &outcomes);
+    }
+    int damaged = trace_error(trace);
+    trace_close(trace);
+    if (damaged) {
+        free(pcs);
+        free(outcomes);
+        return 0;
+    }
+
+    // per configuration, 'chunks' jobs and then the sequential one
+    int perConfig = chunks + chunkCheck;
+    int n = numConfigs * perConfig;
+    sweep_job_t *jobs = (sweep_job_t *) calloc(n, sizeof(sweep_job_t));
+    for (int c = 0; c < numConfigs; c++) {
+        sweep_job_t *job = &jobs[c * perConfig];
+        for (int k = 0; k < chunks; k++, job++) {
+            uint64_t start = count * k / chunks;
+            uint64_t end = count * (k + 1) / chunks;
+            if (pcs != NULL) {
+                job->pcs = pcs + start;
+                job->outcomes = outcomes + start;
+                job->count = end - start;
+            } else {
+                job->trace = tracePath;
+                job->start = start;
+                job->limit = end - start;
+            }
+            job->warmup = (start < chunkWarmup) ? (uint32_t) start : chunkWarmup;
+            job->config = configs[c];
+        }
+        if (chunkCheck) {
+            job->trace = tracePath;
+            job->pcs = pcs;
+            job->outcomes = outcomes;
+            job->count = count;
+            job->config = configs[c];
+        }
+    }
+
+    sweep_run(jobs, n, threads);
+    for (int i = 0; i < n; i++) {
+        if (jobs[i].failed) {
+            free(jobs);
+            return 0;
+        }
+    }
+
+    char name[64];
+    if (numConfigs > 1) {
+        printf("%-28s %10s %10s %18s %12s", "Config", "Branches", "Incorrect", "Misprediction Rate",
+               "Storage Bits");
+        if (chunkCheck) {
+            printf(" %10s %10s", "Sequential", "Difference");
+        }
+        printf("\n");
+    }
+    for (int c = 0; c < numConfigs; c++) {
+        uint64_t mispredictions = 0;
+        for (int k = 0; k < chunks; k++) {
+            mispredictions += jobs[c * perConfig + k].mispredictions;
+        }
+        uint64_t sequential = jobs[c * perConfig + chunks].mispredictions;
+        float mispredict_rate = 100 * ((float) mispredictions / (float) count);
+        uint64_t bits = predictor_config_bits(&configs[c]);
+
+        if (numConfigs == 1) {
+            printf("Branches:        %10llu\n", (unsigned long long) count);
+            printf("Incorrect:       %10llu\n", (unsigned long long) mispredictions);
+            printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+            printf("Storage Bits:    %10llu\n", (unsigned long long) bits);
+            printf("Chunks:          %10d\n", chunks);
+            if (chunkCheck) {
+                printf("Sequential:      %10llu\n", (unsigned long long) sequential);
+                printf("Difference:      %+10lld (%+.4f%%)\n", (long long) (mispredictions - sequential),
+                       100.0 * ((double) mispredictions - sequential) / count);
+            }
+            continue;
+        }
+        predictor_config_name(&configs[c], name, sizeof(name));
+        printf("%-28s %10llu %10llu %18.3f %12llu", name, (unsigned long long) count,
+               (unsigned long long) mispredictions, mispredict_rate, (unsigned long long) bits);
+        if (chunkCheck) {
+            printf(" %10llu %+10lld", (unsigned long long) sequential, (long long) (mispredictions - sequential));
+        }
+        printf("\n");
+    }
+
+    free(jobs);
+    free(pcs);
+    free(outcomes);
+    return 1;
+}
+
+// Print one row per configuration for the interval of 'branches'
+// branches, 'taken' of them taken, that ends at branch 'end'
+//
+void
+print_interval(FILE *out, uint64_t end, uint64_t branches, uint64_t taken,
+               const uint64_t *intervalMisses, const uint64_t *mispredictions) {
+    char name[64];
+    for (int c = 0; c < numConfigs; c++) {
+        predictor_config_name(&configs[c], name, sizeof(name));
+        fprintf(out, "%llu\t%s\t%llu\t%llu\t%.3f\t%.3f\t%.3f\n", (unsigned long long) end, name,
+                (unsigned long long) branches, (unsigned long long) intervalMisses[c],
+                100.0 * intervalMisses[c] / branches, 100.0 * mispredictions[c] / end,
+                100.0 * taken / branches);
+    }
 }
 
 // Process an option and update the predictor
@@ -39,18 +415,134 @@ usage() {
 //
 int
 handle_option(char *arg) {
-    if (!strcmp(arg, "--static")) {
-        bpType = STATIC;
-    } else if (!strncmp(arg, "--gshare:", 9)) {
-        bpType = GSHARE;
-        sscanf(arg + 9, "%d", &ghistoryBits);
-    } else if (!strncmp(arg, "--tournament:", 13)) {
-        bpType = TOURNAMENT;
-        sscanf(arg + 13, "%d:%d:%d", &ghistoryBits, &lhistoryBits, &pcIndexBits);
-    } else if (!strcmp(arg, "--custom")) {
-        bpType = CUSTOM;
+    if (add_config(arg + 2)) {
+        // predictor type
+    } else if (!strncmp(arg, "--configs:", 10)) {
+        return read_configs(arg + 10);
+    } else if (!strcmp(arg, "--sweep")) {
+        sweep = 1;
+    } else if (!strncmp(arg, "--sweep:", 8)) {
+        sweep = 1;
+        return read_traces(arg + 8);
+    } else if (!strncmp(arg, "--tune:", 7)) {
+        unsigned long long budget = 0;
+        if (sscanf(arg + 7, "%llu:%u", &budget, &tunePrefix) < 1 || budget == 0) {
+            return 0;
+        }
+        tuneBudget = budget;
+    } else if (!strncmp(arg, "--max-bits:", 11)) {
+        unsigned long long bits = 0;
+        if (sscanf(arg + 11, "%llu", &bits) != 1) {
+            return 0;
+        }
+        maxBits = bits;
+    } else if (!strncmp(arg, "--sample:", 9)) {
+        if (!sample_parse(arg + 9, &sampleConfig)) {
+            fprintf(stderr, "Bad sampling schedule %s, the period must hold the interval and warm-up\n",
+                    arg + 9);
+            return 0;
+        }
+        sampling = 1;
+    } else if (!strncmp(arg, "--chunks:", 9)) {
+        if (sscanf(arg + 9, "%d:%u", &chunks, &chunkWarmup) < 1 || chunks < 1) {
+            return 0;
+        }
+    } else if (!strcmp(arg, "--chunk-check")) {
+        chunkCheck = 1;
+    } else if (!strcmp(arg, "--profile")) {
+        profileTop = 20;
+    } else if (!strncmp(arg, "--profile:", 10)) {
+        if (sscanf(arg + 10, "%d", &profileTop) != 1 || profileTop < 1) {
+            return 0;
+        }
+    } else if (!strncmp(arg, "--profile-csv:", 14) && arg[14] != '\0') {
+        profilePath = arg + 14;
+    } else if (!strcmp(arg, "--instrument")) {
+        instrumentPath = "-";
+    } else if (!strncmp(arg, "--instrument:", 13) && arg[13] != '\0') {
+        instrumentPath = arg + 13;
+    } else if (!strcmp(arg, "--storage")) {
+        printStorage = 1;
     } else if (!strcmp(arg, "--verbose")) {
         verbose = 1;
+        logPath = "-";
+        logFormat = PREDLOG_TEXT;
+    } else if (!strncmp(arg, "--log:", 6)) {
+        char *path = strchr(arg + 6, ':');
+        if (path == NULL || path[1] == '\0') {
+            return 0;
+        }
+        *path = '\0';
+        logFormat = predlog_format(arg + 6);
+        *path = ':';
+        logPath = path + 1;
+        if (logFormat < 0) {
+            return 0;
+        }
+    } else if (!strncmp(arg, "--interval:", 11)) {
+        unsigned long long n = 0;
+        int end = 0;
+        if (sscanf(arg + 11, "%llu%n", &n, &end) != 1 || n == 0) {
+            return 0;
+        }
+        if (arg[11 + end] == ':' && arg[12 + end] != '\0') {
+            intervalPath = arg + 12 + end;
+        } else if (arg[11 + end] != '\0') {
+            return 0;
+        }
+        interval = n;
+    } else if (!strcmp(arg, "--seekable")) {
+        convertFrame = SEEKABLE_FRAME_BRANCHES;
+    } else if (!strncmp(arg, "--seekable:", 11)) {
+        if (sscanf(arg + 11, "%u", &convertFrame) != 1 || convertFrame == 0 ||
+            convertFrame % TRACE_BLOCK_BRANCHES != 0) {
+            fprintf(stderr, "The frame size must be a multiple of %d branches\n", TRACE_BLOCK_BRANCHES);
+            return 0;
+        }
+    } else if (!strcmp(arg, "--dictionary")) {
+        convertDictionary = 1;
+    } else if (!strncmp(arg, "--start:", 8)) {
+        unsigned long long n = 0;
+        if (sscanf(arg + 8, "%llu", &n) != 1) {
+            return 0;
+        }
+        traceStart = n;
+    } else if (!strncmp(arg, "--branches:", 11)) {
+        unsigned long long n = 0;
+        if (sscanf(arg + 11, "%llu", &n) != 1 || n == 0) {
+            return 0;
+        }
+        traceBranches = n;
+    } else if (!strcmp(arg, "--parse-stats")) {
+        parseStats = 1;
+    } else if (!strcmp(arg, "--log-misses")) {
+        logMisses = 1;
+    } else if (!strncmp(arg, "--convert:", 10) && arg[10] != '\0') {
+        convertPath = arg + 10;
+    } else if (!strncmp(arg, "--threads:", 10)) {
+        sscanf(arg + 10, "%d", &threads);
+    } else if (!strcmp(arg, "--layout:byte")) {
+        layout = LAYOUT_BYTE;
+    } else if (!strcmp(arg, "--layout:packed")) {
+        layout = LAYOUT_PACKED;
+    } else if (!strcmp(arg, "--generic")) {
+        generic = 1;
+    } else if (!strcmp(arg, "--pages:transparent")) {
+        pages = PAGES_TRANSPARENT;
+    } else if (!strcmp(arg, "--pages:huge")) {
+        pages = PAGES_HUGE;
+    } else if (!strcmp(arg, "--pages:small")) {
+        pages = PAGES_SMALL;
+    } else if (!strncmp(arg, "--simd:", 7)) {
+        for (simdLevel = SIMD_AVX512; simdLevel > SIMD_SCALAR; simdLevel--) {
+            if (!strcmp(arg + 7, simdName[simdLevel])) {
+                break;
+            }
+        }
+        if (strcmp(arg + 7, simdName[simdLevel]) || !simd_select(simdLevel)) {
+            fprintf(stderr, "Perceptron kernel %s is not available\n", arg + 7);
+            return 0;
+        }
     } else {
         return 0;
     }
@@ -58,31 +550,41 @@ handle_option(char *arg) {
     return 1;
 }
 
-// Reads a line from the input stream and extracts the
-// PC and Outcome of a branch
+// Reads up to 'max' branches from the trace and extracts the
+// PC and Outcome of each, and the dense branch ID if 'ids' is not NULL
 //
-// Returns True if Successful
+// Returns the number of branches read
 //
-int
-read_branch(uint32_t *pc, uint8_t *outcome) {
-    if (getline(&buf, &len, stream) == -1) {
-        return 0;
+size_t
+read_branches(uint32_t *pcs, uint32_t *ids, uint8_t *outcomes, size_t max) {
+    if (ids != NULL) {
+        return trace_read_ids(trace, pcs, ids, outcomes, max);
     }
+    return trace_read_batch(trace, pcs, outcomes, max);
+}
 
-    uint32_t tmp;
-    sscanf(buf, "0x%x %d\n", pc, &tmp);
-    *outcome = tmp;
-
-    return 1;
+// Print how fast the text trace was parsed
+void
+print_parse_stats() {
+    trace_stats_t stats;
+    trace_stats(trace, &stats);
+    double mb = stats.bytes / 1e6;
+    double parse = stats.seconds - stats.readSeconds;
+    fprintf(stderr, "Parsed %.1f MB, %llu lines (%llu malformed): read %.3f s, parse %.3f s, %.1f MB/s\n",
+            mb, (unsigned long long) stats.lines, (unsigned long long) stats.malformed,
+            stats.readSeconds, parse, (parse > 0) ? mb / parse : 0);
 }
 
 int
 main(int argc, char *argv[]) {
     // Set defaults
-    stream = stdin;
+    threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
     bpType = STATIC;
     verbose = 0;
 
+    // the best perceptron kernel of the CPU, --simd:<kernel> overrides it
+    simdLevel = simd_init();
+
     // run unit tests
     // removed for submission
 //    unit_test();
@@ -92,6 +594,10 @@ main(int argc, char *argv[]) {
         if (!strcmp(argv[i], "--help")) {
             usage();
             exit(0);
+        } else if (!strcmp(argv[i], "--test")) {
+            // run unit tests
+            unit_test();
+            exit(0);
         } else if (!strncmp(argv[i], "--", 2)) {
             if (!handle_option(argv[i])) {
                 printf("Unrecognized option %s\n", argv[i]);
@@ -100,45 +606,406 @@ main(int argc, char *argv[]) {
             }
         } else {
             // Use as input file
-            stream = fopen(argv[i], "r");
+            tracePath = argv[i];
+            add_trace(argv[i]);
+        }
+    }
+
+    // Search the design space instead of simulating given predictors
+    if (tuneBudget > 0) {
+        int ok = tune_run(sweepTraces, numTraces, tuneBudget, tunePrefix, threads, stdout);
+        for (int t = 0; t < numTraces; t++) {
+            free(sweepTraces[t]);
+        }
+        free(sweepTraces);
+        free(configs);
+        return ok ? 0 : 1;
+    }
+
+    // Set the layout on every configuration
+    if (numConfigs == 0) {
+        add_config("static");
+    }
+    for (int c = 0; c < numConfigs; c++) {
+        configs[c].layout = layout;
+        configs[c].generic = generic;
+        configs[c].pages = pages;
+    }
+
+    // Print the storage of every table
+    char name[64];
+    for (int c = 0; c < numConfigs && printStorage; c++) {
+        predictor_storage_t storage;
+        predictor_storage(&configs[c], &storage);
+        predictor_config_name(&configs[c], name, sizeof(name));
+        printf("%s\n", name);
+        for (int k = 0; k < storage.count; k++) {
+            printf("  %-16s %10llu x %3d bits = %10llu\n", storage.items[k].name,
+                   (unsigned long long) storage.items[k].entries, storage.items[k].width,
+                   (unsigned long long) storage.items[k].bits);
+        }
+        printf("  %-16s %34llu\n", "total", (unsigned long long) storage.bits);
+    }
+
+    // Check the storage budget
+    for (int c = 0; c < numConfigs; c++) {
+        uint64_t bits = predictor_config_bits(&configs[c]);
+        if (maxBits > 0 && bits > maxBits) {
+            predictor_config_name(&configs[c], name, sizeof(name));
+            fprintf(stderr, "Predictor %s needs %llu bits, more than --max-bits:%llu\n", name,
+                    (unsigned long long) bits, (unsigned long long) maxBits);
+            exit(1);
+        }
+    }
+    if (printStorage) {
+        exit(0);
+    }
+
+    if (sampling && (sweep || logPath != NULL || convertPath != NULL)) {
+        fprintf(stderr, "--sample cannot be combined with --sweep, --verbose, --log or --convert\n");
+        exit(1);
+    }
+    if (chunks > 0 && (sweep || sampling || logPath != NULL || convertPath != NULL)) {
+        fprintf(stderr, "--chunks cannot be combined with --sweep, --sample, --verbose, --log or --convert\n");
+        exit(1);
+    }
+    if ((profileTop > 0 || profilePath != NULL) && (sweep || sampling || chunks > 0)) {
+        fprintf(stderr, "--profile cannot be combined with --sweep, --sample or --chunks\n");
+        exit(1);
+    }
+    if (interval > 0 && (sweep || sampling || chunks > 0)) {
+        fprintf(stderr, "--interval cannot be combined with --sweep, --sample or --chunks\n");
+        exit(1);
+    }
+    if ((traceStart > 0 || traceBranches > 0) && (sweep || chunks > 0)) {
+        fprintf(stderr, "--start and --branches cannot be combined with --sweep or --chunks\n");
+        exit(1);
+    }
+    if (traceBranches > 0 && convertPath != NULL) {
+        fprintf(stderr, "--branches cannot be combined with --convert\n");
+        exit(1);
+    }
+    if (convertFrame > 0 && convertPath == NULL) {
+        fprintf(stderr, "--seekable needs --convert\n");
+        exit(1);
+    }
+    if (convertDictionary && convertPath == NULL) {
+        fprintf(stderr, "--dictionary needs --convert\n");
+        exit(1);
+    }
+    if (convertDictionary && convertFrame > 0) {
+        fprintf(stderr, "--dictionary cannot be combined with --seekable\n");
+        exit(1);
+    }
+    if (chunkCheck && chunks == 0) {
+        chunks = 1;
+    }
+
+    // Simulate the trace x configuration grid instead of one trace
+    if (sweep) {
+        int ok = run_sweep();
+        for (int t = 0; t < numTraces; t++) {
+            free(sweepTraces[t]);
+        }
+        free(sweepTraces);
+        free(configs);
+        return ok ? 0 : 1;
+    }
+
+    // Simulate chunks of the trace in parallel
+    if (chunks > 0) {
+        int ok = run_chunks();
+        if (!ok) {
+            fprintf(stderr, "Cannot read trace %s\n", tracePath ? tracePath : "<stdin>");
+        }
+        for (int t = 0; t < numTraces; t++) {
+            free(sweepTraces[t]);
+        }
+        free(sweepTraces);
+        free(configs);
+        return ok ? 0 : 1;
+    }
+
+    trace = trace_open(tracePath, threads);
+    if (trace == NULL) {
+        fprintf(stderr, "Cannot open trace %s\n", tracePath ? tracePath : "<stdin>");
+        exit(1);
+    }
+    if (traceStart > 0 && !trace_seek(trace, traceStart)) {
+        fprintf(stderr, "Cannot start at branch %llu, the trace is shorter\n", (unsigned long long) traceStart);
+        exit(1);
+    }
+
+    // Convert the trace instead of simulating it
+    if (convertPath != NULL) {
+        const char *format = "binary";
+        int64_t count;
+        if (convertFrame > 0) {
+            format = "seekable";
+            count = trace_convert_seekable(trace, convertPath, convertFrame);
+        } else if (convertDictionary) {
+            format = "dictionary";
+            count = trace_convert_dictionary(trace, convertPath);
+        } else {
+            count = trace_convert(trace, convertPath);
+        }
+        if (parseStats) {
+            print_parse_stats();
+        }
+        int damaged = trace_error(trace);
+        trace_close(trace);
+        if (damaged) {
+            fprintf(stderr, "Trace %s is damaged, not converted\n", tracePath ? tracePath : "<stdin>");
+            remove(convertPath);
+            exit(1);
         }
+        if (count < 0) {
+            fprintf(stderr, "Cannot write %s trace %s\n", format, convertPath);
+            exit(1);
+        }
+        printf("Converted:       %10lld\n", (long long) count);
+        return 0;
     }
 
-    // Initialize the predictor
-    init_predictor();
+    // Initialize one predictor per configuration
+    predictor_t **predictors = (predictor_t **) malloc(numConfigs * sizeof(predictor_t *));
+    uint64_t *mispredictions = (uint64_t *) calloc(numConfigs, sizeof(uint64_t));
+    uint64_t *intervalMisses = (uint64_t *) calloc(numConfigs, sizeof(uint64_t));
+    sampler_t *samplers = (sampler_t *) malloc(numConfigs * sizeof(sampler_t));
+    profile_t **profiles = (profile_t **) calloc(numConfigs, sizeof(profile_t *));
+    int profiling = profileTop > 0 || profilePath != NULL;
+    for (int c = 0; c < numConfigs; c++) {
+        predictors[c] = predictor_create(&configs[c]);
+        if (predictors[c] == NULL) {
+            predictor_config_name(&configs[c], name, sizeof(name));
+            fprintf(stderr, "Cannot allocate the tables of %s\n", name);
+            exit(1);
+        }
+        if (pages == PAGES_HUGE && strcmp(predictor_backing_name(predictors[c]), backingName[BACKING_HUGETLB])) {
+            predictor_config_name(&configs[c], name, sizeof(name));
+            fprintf(stderr, "No reserved huge pages for %s, using %s\n", name,
+                    predictor_backing_name(predictors[c]));
+        }
+        sample_init(&samplers[c], &sampleConfig);
+        if (profiling) {
+            profiles[c] = profile_create();
+        }
+    }
 
-    uint32_t num_branches = 0;
-    uint32_t mispredictions = 0;
-    uint32_t pc = 0;
-    uint8_t outcome = NOTTAKEN;
+    // Open the prediction log
+    predlog_t *log = NULL;
+    if (logPath != NULL) {
+        char **names = (char **) malloc(numConfigs * sizeof(char *));
+        for (int c = 0; c < numConfigs; c++) {
+            names[c] = (char *) malloc(sizeof(name));
+            predictor_config_name(&configs[c], names[c], sizeof(name));
+        }
+        log = predlog_open(logPath, logFormat, logMisses, names, numConfigs);
+        for (int c = 0; c < numConfigs; c++) {
+            free(names[c]);
+        }
+        free(names);
+        if (log == NULL) {
+            fprintf(stderr, "Cannot write prediction log %s\n", logPath);
+            exit(1);
+        }
+    }
 
-    // Reach each branch from the trace
-    while (read_branch(&pc, &outcome)) {
-        num_branches++;
+    // Open the interval statistics
+    FILE *intervalOut = NULL;
+    uint64_t intervalBranches = 0;
+    uint64_t intervalTaken = 0;
+    if (interval > 0) {
+        intervalOut = (intervalPath != NULL) ? fopen(intervalPath, "w") : stderr;
+        if (intervalOut == NULL) {
+            fprintf(stderr, "Cannot write interval statistics %s\n", intervalPath);
+            exit(1);
+        }
+        fprintf(intervalOut, "end\tconfig\tbranches\tincorrect\tmispredict_rate\tcumulative_rate\ttaken_rate\n");
+    }
 
-        // Make a prediction and compare with actual outcome
-        uint8_t prediction = make_prediction(pc);
-        if (prediction != outcome) {
-            mispredictions++;
+    uint64_t num_branches = 0;
+    uint32_t pcs[BATCH_SIZE];
+    uint32_t ids[BATCH_SIZE];
+    uint8_t outcomes[BATCH_SIZE];
+    uint8_t misses[BATCH_SIZE];
+    size_t n;
+
+    // Reach each branch from the trace, a batch at a time
+    do {
+        size_t want = BATCH_SIZE;
+        if (traceBranches > 0 && traceBranches - num_branches < want) {
+            want = traceBranches - num_branches;
         }
-        if (verbose != 0) {
-            printf("PC: 0x%x, Prediction: %d, Actual Outcome: %d\n", pc, prediction, outcome);
+        n = read_branches(pcs, profiling ? ids : NULL, outcomes, want);
+
+        // simulate up to the end of the batch or of the interval
+        for (size_t i = 0, m; i < n; i += m) {
+            m = n - i;
+            if (interval > 0 && m > interval - intervalBranches) {
+                m = interval - intervalBranches;
+            }
+
+            for (int c = 0; c < numConfigs; c++) {
+                if (sampling) {
+                    sample_batch(&samplers[c], predictors[c], pcs + i, outcomes + i, m);
+                    continue;
+                }
+
+                // Make predictions, compare with actual outcomes and train
+                uint32_t missed = predict_and_train(predictors[c], pcs + i, outcomes + i, m,
+                                                    (log || profiling) ? misses + i : NULL);
+                mispredictions[c] += missed;
+                intervalMisses[c] += missed;
+                if (profiling) {
+                    profile_batch_ids(profiles[c], ids + i, pcs + i, outcomes + i, misses + i, m);
+                }
+                if (log != NULL) {
+                    predlog_batch(log, c, num_branches, pcs + i, outcomes + i, misses + i, m);
+                }
+            }
+            num_branches += m;
+
+            if (interval > 0) {
+                for (size_t k = i; k < i + m; k++) {
+                    intervalTaken += outcomes[k];
+                }
+                intervalBranches += m;
+                if (intervalBranches == interval) {
+                    print_interval(intervalOut, num_branches, intervalBranches, intervalTaken,
+                                   intervalMisses, mispredictions);
+                    intervalBranches = 0;
+                    intervalTaken = 0;
+                    memset(intervalMisses, 0, numConfigs * sizeof(uint64_t));
+                }
+            }
         }
+    } while (n == BATCH_SIZE);
 
-        // Train the predictor
-        train_predictor(pc, outcome);
+    // Print nothing from a damaged trace
+    if (trace_error(trace)) {
+        fprintf(stderr, "Trace %s is damaged, no results\n", tracePath ? tracePath : "<stdin>");
+        exit(1);
     }
 
-    // Print out the mispredict statistics
-    printf("Branches:        %10d\n", num_branches);
-    printf("Incorrect:       %10d\n", mispredictions);
-    float mispredict_rate = 100 * ((float) mispredictions / (float) num_branches);
-    printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+    // the last interval may be shorter
+    if (interval > 0) {
+        if (intervalBranches > 0) {
+            print_interval(intervalOut, num_branches, intervalBranches, intervalTaken,
+                           intervalMisses, mispredictions);
+        }
+        if (intervalOut != stderr) {
+            fclose(intervalOut);
+        }
+    }
+
+    // Write the rest of the log before the statistics
+    if (log != NULL && !predlog_close(log)) {
+        fprintf(stderr, "Cannot write prediction log %s\n", logPath);
+        exit(1);
+    }
+
+    // Print out the sampled estimates
+    if (sampling) {
+        double rate, halfWidth;
+        if (numConfigs == 1) {
+            sample_estimate(&samplers[0], &rate, &halfWidth);
+            printf("Branches:        %10llu\n", (unsigned long long) num_branches);
+            printf("Measured:        %10llu\n", (unsigned long long) samplers[0].measured);
+            printf("Intervals:       %10u\n", samplers[0].intervals);
+            printf("Misprediction Rate: %7.3f +- %.3f (%s)\n", rate, halfWidth,
+                   sampleConfig.functional ? "95%" : "95%, sampling error only");
+            printf("Storage Bits:    %10llu\n", (unsigned long long) predictor_config_bits(&configs[0]));
+        } else {
+            printf("%-28s %10s %10s %10s %18s %10s %12s\n", "Config", "Branches", "Measured", "Intervals",
+                   "Misprediction Rate", sampleConfig.functional ? "95% CI +-" : "Sampling +-", "Storage Bits");
+            for (int c = 0; c < numConfigs; c++) {
+                sample_estimate(&samplers[c], &rate, &halfWidth);
+                predictor_config_name(&configs[c], name, sizeof(name));
+                printf("%-28s %10llu %10llu %10u %18.3f %10.3f %12llu\n", name, (unsigned long long) num_branches,
+                       (unsigned long long) samplers[c].measured, samplers[c].intervals, rate, halfWidth,
+                       (unsigned long long) predictor_config_bits(&configs[c]));
+            }
+        }
+    } else if (numConfigs == 1) {
+        printf("Branches:        %10llu\n", (unsigned long long) num_branches);
+        printf("Incorrect:       %10llu\n", (unsigned long long) mispredictions[0]);
+        float mispredict_rate = 100 * ((float) mispredictions[0] / (float) num_branches);
+        printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+        printf("Storage Bits:    %10llu\n", (unsigned long long) predictor_config_bits(&configs[0]));
+    } else {
+        printf("%-28s %10s %10s %18s %12s\n", "Config", "Branches", "Incorrect", "Misprediction Rate",
+               "Storage Bits");
+        for (int c = 0; c < numConfigs; c++) {
+            predictor_config_name(&configs[c], name, sizeof(name));
+            float mispredict_rate = 100 * ((float) mispredictions[c] / (float) num_branches);
+            printf("%-28s %10llu %10llu %18.3f %12llu\n", name, (unsigned long long) num_branches,
+                   (unsigned long long) mispredictions[c], mispredict_rate,
+                   (unsigned long long) predictor_config_bits(&configs[c]));
+        }
+    }
+
+    // Print the worst branches and write the profile
+    for (int c = 0; c < numConfigs && profileTop > 0; c++) {
+        predictor_config_name(&configs[c], name, sizeof(name));
+        printf("\nTop %d of %u branches by mispredictions, %s\n", profileTop,
+               profile_size(profiles[c]), name);
+        profile_print_top(profiles[c], stdout, profileTop);
+    }
+    if (profilePath != NULL) {
+        FILE *csv = fopen(profilePath, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "Cannot write profile %s\n", profilePath);
+            exit(1);
+        }
+        fprintf(csv, "config,pc,executions,mispredictions,taken\n");
+        for (int c = 0; c < numConfigs; c++) {
+            predictor_config_name(&configs[c], name, sizeof(name));
+            profile_write_csv(profiles[c], csv, name);
+        }
+        fclose(csv);
+    }
+
+    // Print the table statistics
+    if (instrumentPath != NULL) {
+        FILE *out = strcmp(instrumentPath, "-") ? fopen(instrumentPath, "w") : stdout;
+        if (out == NULL) {
+            fprintf(stderr, "Cannot write %s\n", instrumentPath);
+            exit(1);
+        }
+        for (int c = 0; c < numConfigs; c++) {
+            if (!predictor_report(predictors[c], out)) {
+                fprintf(stderr, "No table statistics, build with -DINSTRUMENT\n");
+                exit(1);
+            }
+        }
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+
+    if (parseStats) {
+        print_parse_stats();
+    }
 
     // Cleanup
-    fclose(stream);
-    free(buf);
-    destructor();
+    trace_close(trace);
+    for (int c = 0; c < numConfigs; c++) {
+        predictor_destroy(predictors[c]);
+        if (profiles[c] != NULL) {
+            profile_destroy(profiles[c]);
+        }
+    }
+    free(predictors);
+    free(mispredictions);
+    free(intervalMisses);
+    free(samplers);
+    free(profiles);
+    free(configs);
+    for (int t = 0; t < numTraces; t++) {
+        free(sweepTraces[t]);
+    }
+    free(sweepTraces);
 
     return 0;
 }
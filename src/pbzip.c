@@ -0,0 +1,418 @@
+//========================================================//
+//  pbzip.c                                               //
+//  Source file for the parallel bzip2 decompressor       //
+//                                                        //
+//  The scanner thread looks for the 48-bit block and     //
+//  end-of-stream magics at every bit offset. Each block  //
+//  is rebuilt into a standalone single-block stream      //
+//  (like bzip2recover does), which a worker decodes      //
+//  with libbz2 into its slot of the ring. A chance match //
+//  of a magic inside a block splits it, so a block that  //
+//  fails is joined with the segments after it and        //
+//  decoded again (like pbzip2) before it is reported.    //
+//========================================================//
+
+#define _GNU_SOURCE
+
+#include <bzlib.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pbzip.h"
+
+#define BLOCK_MAGIC  0x314159265359ULL
+#define EOS_MAGIC    0x177245385090ULL
+#define MAGIC_MASK   0xffffffffffffULL
+#define MAGIC_BITS   48
+#define CRC_BITS     32
+
+// Segments joined to a failed block at most, less than the ring size
+#define MAX_JOINED   2
+
+// Slot states
+#define SLOT_PENDING 0  // filled by the scanner, waiting for a worker
+#define SLOT_RUNNING 1  // being decoded
+#define SLOT_DONE    2  // decoded, waiting for the consumer
+#define SLOT_FAILED  3  // block did not decode
+
+typedef struct {
+    int state;
+    uint64_t start;     // bit offset of the block magic
+    uint64_t end;       // bit offset of the next magic
+    int gap;            // from an end-of-stream magic, holds no data
+    uint8_t *in;        // rebuilt single-block stream
+    size_t inCap;
+    uint8_t *out;       // decompressed block
+    size_t outLen;
+    size_t outCap;
+} slot_t;
+
+struct pbzip {
+    const uint8_t *data;   // compressed input
+    size_t len;
+    int mapped;
+
+    int threads;
+    pthread_t scanner;
+    pthread_t *workers;
+
+    slot_t *ring;
+    uint64_t ringSize;
+    uint64_t head;         // next slot handed to the consumer
+    uint64_t claim;        // next slot decoded by a worker
+    uint64_t tail;         // next slot filled by the scanner
+    int held;              // slots from ring[head] the consumer still holds
+    int scanDone;
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+//------------------------------------//
+//          Block Rebuilding          //
+//------------------------------------//
+
+typedef struct {
+    uint8_t *buf;
+    size_t pos;            // bytes written
+    uint32_t acc;          // pending bits
+    int nacc;
+} bitwriter_t;
+
+static void
+put_bits(bitwriter_t *w, uint64_t value, int nbits) {
+    while (nbits-- > 0) {
+        w->acc = (w->acc << 1) | ((value >> nbits) & 1);
+        if (++w->nacc == 8) {
+            w->buf[w->pos++] = (uint8_t) w->acc;
+            w->acc = 0;
+            w->nacc = 0;
+        }
+    }
+}
+
+static uint64_t
+get_bits(const uint8_t *data, uint64_t pos, int nbits) {
+    uint64_t value = 0;
+    for (int i = 0; i < nbits; i++, pos++) {
+        value = (value << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+    }
+    return value;
+}
+
+// Build "BZh9" + block + end-of-stream marker + CRC into slot->in. For
+// a single block stream the combined CRC equals the block CRC.
+static size_t
+rebuild_block(const uint8_t *data, slot_t *slot) {
+    uint64_t nbits = slot->end - slot->start;
+    size_t need = 4 + nbits / 8 + 16;
+    if (need > slot->inCap) {
+        slot->in = (uint8_t *) realloc(slot->in, need);
+        slot->inCap = need;
+    }
+
+    bitwriter_t w = {slot->in, 0, 0, 0};
+    memcpy(w.buf, "BZh9", 4);
+    w.pos = 4;
+
+    // copy whole bytes from an arbitrary bit offset
+    uint64_t pos = slot->start;
+    int shift = pos & 7;
+    const uint8_t *src = data + (pos >> 3);
+    size_t bytes = nbits / 8;
+    if (shift == 0) {
+        memcpy(w.buf + w.pos, src, bytes);
+    } else {
+        for (size_t i = 0; i < bytes; i++) {
+            w.buf[w.pos + i] = (uint8_t) ((src[i] << shift) | (src[i + 1] >> (8 - shift)));
+        }
+    }
+    w.pos += bytes;
+    pos += bytes * 8;
+
+    put_bits(&w, get_bits(data, pos, (int) (slot->end - pos)), (int) (slot->end - pos));
+    put_bits(&w, EOS_MAGIC, MAGIC_BITS);
+    put_bits(&w, get_bits(data, slot->start + MAGIC_BITS, CRC_BITS), CRC_BITS);
+    if (w.nacc > 0) {
+        put_bits(&w, 0, 8 - w.nacc);
+    }
+    return w.pos;
+}
+
+// Decode one block into slot->out, returns True if Successful
+static int
+decode_block(const uint8_t *data, slot_t *slot) {
+    size_t inLen = rebuild_block(data, slot);
+
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+        return 0;
+    }
+
+    if (slot->outCap == 0) {
+        slot->outCap = 1 << 20;
+        slot->out = (uint8_t *) malloc(slot->outCap);
+    }
+    strm.next_in = (char *) slot->in;
+    strm.avail_in = (unsigned int) inLen;
+    slot->outLen = 0;
+
+    int ret;
+    do {
+        if (slot->outLen == slot->outCap) {
+            slot->outCap *= 2;
+            slot->out = (uint8_t *) realloc(slot->out, slot->outCap);
+        }
+        strm.next_out = (char *) slot->out + slot->outLen;
+        strm.avail_out = (unsigned int) (slot->outCap - slot->outLen);
+        ret = BZ2_bzDecompress(&strm);
+        slot->outLen = slot->outCap - strm.avail_out;
+    } while (ret == BZ_OK && (strm.avail_in > 0 || strm.avail_out == 0));
+
+    BZ2_bzDecompressEnd(&strm);
+    return ret == BZ_STREAM_END;
+}
+
+//------------------------------------//
+//              Threads               //
+//------------------------------------//
+
+// Hand the segment [start, end) to the workers, blocks while the ring is
+// full. A gap is passed on undecoded, in case a failed block is joined
+// across it.
+// Returns False once the decompressor is being closed
+static int
+submit_block(pbzip_t *pbz, uint64_t start, uint64_t end, int gap) {
+    pthread_mutex_lock(&pbz->lock);
+    while (!pbz->stop && pbz->tail - pbz->head >= pbz->ringSize) {
+        pthread_cond_wait(&pbz->changed, &pbz->lock);
+    }
+    if (!pbz->stop) {
+        slot_t *slot = &pbz->ring[pbz->tail % pbz->ringSize];
+        slot->start = start;
+        slot->end = end;
+        slot->gap = gap;
+        slot->outLen = 0;
+        slot->state = SLOT_PENDING;
+        pbz->tail++;
+        pthread_cond_broadcast(&pbz->changed);
+    }
+    int running = !pbz->stop;
+    pthread_mutex_unlock(&pbz->lock);
+    return running;
+}
+
+static void *
+scan_blocks(void *arg) {
+    pbzip_t *pbz = (pbzip_t *) arg;
+    uint64_t bits = 0;
+    uint64_t block = UINT64_MAX;   // start of the open segment
+    int gap = 0;
+    int running = 1;
+
+    for (size_t i = 0; i < pbz->len && running; i++) {
+        uint8_t byte = pbz->data[i];
+        for (int b = 7; b >= 0; b--) {
+            bits = (bits << 1) | ((byte >> b) & 1);
+            uint64_t magic = bits & MAGIC_MASK;
+            if (magic != BLOCK_MAGIC && magic != EOS_MAGIC) {
+                continue;
+            }
+
+            uint64_t pos = (uint64_t) i * 8 + (8 - b) - MAGIC_BITS;
+            if (block != UINT64_MAX) {
+                running = submit_block(pbz, block, pos, gap);
+            }
+            block = pos;
+            gap = magic == EOS_MAGIC;
+        }
+    }
+
+    pthread_mutex_lock(&pbz->lock);
+    pbz->scanDone = 1;
+    pthread_cond_broadcast(&pbz->changed);
+    pthread_mutex_unlock(&pbz->lock);
+    return NULL;
+}
+
+static void *
+decode_blocks(void *arg) {
+    pbzip_t *pbz = (pbzip_t *) arg;
+
+    pthread_mutex_lock(&pbz->lock);
+    for (;;) {
+        while (!pbz->stop && pbz->claim == pbz->tail && !pbz->scanDone) {
+            pthread_cond_wait(&pbz->changed, &pbz->lock);
+        }
+        if (pbz->stop || pbz->claim == pbz->tail) {
+            break;
+        }
+
+        slot_t *slot = &pbz->ring[pbz->claim % pbz->ringSize];
+        slot->state = SLOT_RUNNING;
+        pbz->claim++;
+        pthread_mutex_unlock(&pbz->lock);
+
+        int ok = slot->gap || decode_block(pbz->data, slot);
+
+        pthread_mutex_lock(&pbz->lock);
+        slot->state = ok ? SLOT_DONE : SLOT_FAILED;
+        pthread_cond_broadcast(&pbz->changed);
+    }
+    pthread_mutex_unlock(&pbz->lock);
+    return NULL;
+}
+
+//------------------------------------//
+//        Decompressor Functions      //
+//------------------------------------//
+
+int
+pbzip_is_bzip2(const uint8_t *header) {
+    return header[0] == 'B' && header[1] == 'Z' && header[2] == 'h' &&
+           header[3] >= '1' && header[3] <= '9';
+}
+
+// Read a whole non-seekable stream into memory
+static uint8_t *
+read_all(FILE *stream, size_t *len) {
+    size_t cap = 1 << 20;
+    uint8_t *buf = (uint8_t *) malloc(cap);
+    size_t n;
+    *len = 0;
+    while ((n = fread(buf + *len, 1, cap - *len, stream)) > 0) {
+        *len += n;
+        if (*len == cap) {
+            cap *= 2;
+            buf = (uint8_t *) realloc(buf, cap);
+        }
+    }
+    return buf;
+}
+
+pbzip_t *
+pbzip_open(FILE *stream, int threads) {
+    pbzip_t *pbz = (pbzip_t *) calloc(1, sizeof(pbzip_t));
+
+    struct stat st;
+    int fd = fileno(stream);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            pbz->data = (const uint8_t *) map;
+            pbz->len = st.st_size;
+            pbz->mapped = 1;
+        }
+    }
+    if (!pbz->mapped) {
+        pbz->data = read_all(stream, &pbz->len);
+    }
+
+    if (pbz->len < 4 || !pbzip_is_bzip2(pbz->data)) {
+        pbz->threads = 0;
+        pbzip_close(pbz);
+        return NULL;
+    }
+
+    pbz->threads = (threads < 1) ? 1 : threads;
+    pbz->ringSize = 2 * pbz->threads + 2;
+    pbz->ring = (slot_t *) calloc(pbz->ringSize, sizeof(slot_t));
+    pbz->workers = (pthread_t *) malloc(pbz->threads * sizeof(pthread_t));
+    pthread_mutex_init(&pbz->lock, NULL);
+    pthread_cond_init(&pbz->changed, NULL);
+
+    pthread_create(&pbz->scanner, NULL, scan_blocks, pbz);
+    for (int i = 0; i < pbz->threads; i++) {
+        pthread_create(&pbz->workers[i], NULL, decode_blocks, pbz);
+    }
+    return pbz;
+}
+
+int
+pbzip_next(pbzip_t *pbz, const uint8_t **data, size_t *len) {
+    pthread_mutex_lock(&pbz->lock);
+
+    // release the chunk returned by the previous call
+    if (pbz->held) {
+        pbz->head += pbz->held;
+        pbz->held = 0;
+        pthread_cond_broadcast(&pbz->changed);
+    }
+
+    for (;;) {
+        if (pbz->head < pbz->tail) {
+            int state = pbz->ring[pbz->head % pbz->ringSize].state;
+            if (state == SLOT_DONE || state == SLOT_FAILED) {
+                break;
+            }
+        } else if (pbz->scanDone) {
+            pthread_mutex_unlock(&pbz->lock);
+            return 0;
+        }
+        pthread_cond_wait(&pbz->changed, &pbz->lock);
+    }
+
+    // join a failed block with the next segments, once they are done
+    slot_t *slot = &pbz->ring[pbz->head % pbz->ringSize];
+    int joined = 0;
+    while (slot->state == SLOT_FAILED && joined < MAX_JOINED) {
+        uint64_t next = pbz->head + 1 + joined;
+        while (next < pbz->tail ? pbz->ring[next % pbz->ringSize].state < SLOT_DONE : !pbz->scanDone) {
+            pthread_cond_wait(&pbz->changed, &pbz->lock);
+        }
+        if (next == pbz->tail) {
+            break;
+        }
+        slot->end = pbz->ring[next % pbz->ringSize].end;
+        joined++;
+
+        pthread_mutex_unlock(&pbz->lock);
+        int ok = decode_block(pbz->data, slot);
+        pthread_mutex_lock(&pbz->lock);
+        slot->state = ok ? SLOT_DONE : SLOT_FAILED;
+    }
+    pbz->held = 1 + ((slot->state == SLOT_DONE) ? joined : 0);
+    pthread_mutex_unlock(&pbz->lock);
+
+    if (slot->state == SLOT_FAILED) {
+        return -1;
+    }
+    *data = slot->out;
+    *len = slot->outLen;
+    return 1;
+}
+
+void
+pbzip_close(pbzip_t *pbz) {
+    if (pbz->threads > 0) {
+        pthread_mutex_lock(&pbz->lock);
+        pbz->stop = 1;
+        pthread_cond_broadcast(&pbz->changed);
+        pthread_mutex_unlock(&pbz->lock);
+
+        pthread_join(pbz->scanner, NULL);
+        for (int i = 0; i < pbz->threads; i++) {
+            pthread_join(pbz->workers[i], NULL);
+        }
+        for (uint64_t i = 0; i < pbz->ringSize; i++) {
+            free(pbz->ring[i].in);
+            free(pbz->ring[i].out);
+        }
+        pthread_mutex_destroy(&pbz->lock);
+        pthread_cond_destroy(&pbz->changed);
+        free(pbz->ring);
+        free(pbz->workers);
+    }
+
+    if (pbz->mapped) {
+        munmap((void *) pbz->data, pbz->len);
+    } else {
+        free((void *) pbz->data);
+    }
+    free(pbz);
+}
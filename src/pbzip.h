@@ -0,0 +1,40 @@
+//========================================================//
+//  pbzip.h                                               //
+//  Header file for the parallel bzip2 decompressor       //
+//                                                        //
+//  A bzip2 file is split at its block boundaries, the    //
+//  blocks are decoded on a pool of worker threads and    //
+//  handed back in file order through a bounded ring.     //
+//========================================================//
+
+#ifndef PBZIP_H
+#define PBZIP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct pbzip pbzip_t;
+
+// True if 'header' (at least 4 bytes) starts a bzip2 stream
+//
+int pbzip_is_bzip2(const uint8_t *header);
+
+// Start decompressing 'stream' with 'threads' workers. Regular files
+// are mapped, anything else is read into memory first.
+// Returns NULL if the stream is not a bzip2 file
+//
+pbzip_t *pbzip_open(FILE *stream, int threads);
+
+// Get the next decompressed chunk in file order. The chunk stays
+// valid until the next call.
+//
+// Returns 1 if a chunk was returned, 0 at the end, -1 on a block that
+// does not decode even joined with the segments after it
+//
+int pbzip_next(pbzip_t *pbz, const uint8_t **data, size_t *len);
+
+// Stop the workers and release all buffers
+//
+void pbzip_close(pbzip_t *pbz);
+
+#endif
@@ -6,8 +6,13 @@
 //  described in the README                               //
 //========================================================//
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "predictor.h"
 #include "helpers.h"
+#include "simd.h"
+#include "instrument.h"
+#include "arena.h"
 #include <math.h>
 
 const char *studentName = "Hou Wang";
@@ -18,8 +23,8 @@ const char *email = "how038@eng.ucsd.edu";
 //------------------------------------//
 
 // Handy Global for use in output routines
-const char *bpName[4] = {"Static", "Gshare",
-                         "Tournament", "Custom"};
+const char *bpName[5] = {"Static", "Gshare",
+                         "Tournament", "Custom", "TAGE"};
 
 int ghistoryBits; // Number of bits used for Global History
 int lhistoryBits; // Number of bits used for Local History
@@ -32,30 +37,89 @@ int32_t theta;
 //      Predictor Data Structures     //
 //------------------------------------//
 
+typedef uint32_t (*batch_fn)(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+                            size_t n, uint8_t *mispredict_out);
 
-// Data structure for Global History Register
-// 1. ghr: global history bits array - 32 bits
-// 2. ghrMask: mask used for masking ghr for indexing ghistoryBuffer
-// 3. ghistoryBuffer: the 2-bit prediction table for using global history
+// A predict_and_train loop specialized for one configuration
+typedef struct {
+    int bpType;
+    int ghistoryBits;
+    int lhistoryBits;
+    int pcIndexBits;
+    batch_fn byte;     // LAYOUT_BYTE version
+    batch_fn packed;   // LAYOUT_PACKED version
+} kernel_t;
 
-uint32_t ghr;
-uint32_t ghrMask;
-uint8_t *ghistoryBuffer;
-uint32_t ghrSize; // number of entries
+// State of one predictor instance
+struct predictor {
+    predictor_config_t config;
+    batch_fn batch;            // specialized kernel, NULL to use the generic loops
 
-// 2-bit predictor selector
-uint8_t *selectorBuffer;
+    // Global History Register
+    // 1. ghr: global history bits array - 32 bits
+    // 2. ghrMask: mask used for masking ghr for indexing ghistoryBuffer
+    // 3. ghistoryBuffer: the 2-bit prediction table for using global history
+    uint32_t ghr;
+    uint32_t ghrMask;
+    uint8_t *ghistoryBuffer;
+    uint32_t ghrSize;          // number of entries
 
-// 2-bit prediction buffer for local predictor
-uint32_t *pht;             // pattern history table, size by pcIndexBits
-uint32_t pcIndexMask;      // Mask for using pc to index pht
-uint32_t phtMask;          // Mask using lhistoryBits to mask pht entry
-uint32_t phtSize;          // equal to size of pht, 2^pcIndexBits
-uint8_t *lpredictionTable; // local prediction table, 2-bit saturating counter, size by lhistoryBits
-uint32_t lptSize;          // size by lhistoryBits
+    // 2-bit predictor selector, shares ghistoryBuffer in the tournament
+    // predictor unless built with SPLIT_SELECTOR (see SELECTOR_ENTRY)
+    uint8_t *selectorBuffer;
 
-// Perceptron implementation (GHR only version)
-int32_t **perceptronTable; // perceptron table
+    // 2-bit prediction buffer for local predictor
+    uint32_t *pht;             // pattern history table, size by pcIndexBits
+    uint8_t *phtBits;          // pht with lhistoryBits per entry, LAYOUT_PACKED only
+    uint32_t pcIndexMask;      // Mask for using pc to index pht
+    uint32_t phtMask;          // Mask using lhistoryBits to mask pht entry
+    uint32_t phtSize;          // equal to size of pht, 2^pcIndexBits
+    uint8_t *lpredictionTable; // local prediction table, 2-bit saturating counter, size by lhistoryBits
+    uint32_t lptSize;          // size by lhistoryBits
+
+    // ghistoryBuffer, selectorBuffer and lpredictionTable hold one counter
+    // per byte, or four per byte with LAYOUT_PACKED (see helpers.h)
+
+    // Perceptron implementation (GHR only version)
+    // one contiguous matrix of 2^pcIndexBits rows, each row holds
+    // ghistoryBits + 1 saturating 8-bit weights padded to whole cache lines
+    int8_t *perceptronTable;
+    uint32_t perceptronStride;                    // bytes per row
+    uint32_t perceptronMask;                      // Mask for using pc ^ ghr to index rows
+    uint64_t perceptronHistory[PERCEPTRON_HISTORY_WORDS]; // input bits, see helpers.h
+
+    // TAGE, see tage.h
+    tage_t *tage;
+
+    // table statistics, only with -DINSTRUMENT
+    instrument_t *inst;
+
+    // the block holding this struct and every table above
+    arena_t arena;
+};
+
+// Build with -DINSTRUMENT to record the aliasing and counter states of
+// the tables (see instrument.h), otherwise the hooks compile to nothing
+#ifdef INSTRUMENT
+#define INSTRUMENT_HOOK(statement) statement
+#else
+#define INSTRUMENT_HOOK(statement)
+#endif
+
+// Instrumented tables, in the order predictor_create() adds them
+#define STATS_GLOBAL  0     // ghistoryBuffer, or the perceptron rows
+#define STATS_PHT     1     // tournament local histories
+#define STATS_LOCAL   2     // tournament local counters
+
+static batch_fn find_kernel(const predictor_config_t *config);
+
+// The functions of the original interface operate on this default instance
+predictor_t *predictor;
+
+// lookup of the last make_prediction(), reused by train_predictor() for
+// the same pc
+static predictor_lookup_t lastLookup;
+static int lastLookupValid = 0;
 
 //---------------------------------------------//
 //        Custom Predictor Description         //
@@ -65,178 +129,924 @@ int32_t **perceptronTable; // perceptron table
 // Branch Prediction". The implemented predictor is a simplified version using only global history.
 // Predictor consists of a global history register, a Perceptron Table storing weights that correspond to history bits
 // which indicate the correlation between history bits and the specific pc xor ghr address (for anti-aliasing)
-// In the design, ghistoryBits is 13 bits, thus the perceptron entry length is 14 bits (1 bit for w0)
-// Hardware Size: since there is only a perceptron table used, its size is 2^(ghistoryBits + 1) = 2^14 = 16Kbits
-// the GHR in this case is 13 bits
-// Thus the total size is 16 Kbits + 13 bits < 16 Kbits + 256 bits
+// In the design, ghistoryBits is 13 bits, thus the perceptron entry length is 14 weights (1 for w0)
+// Weights are 8-bit saturating counters in [-127, 127], stored as one cache-aligned matrix
+// Hardware Size: 2^pcIndexBits rows of ghistoryBits + 1 8-bit weights, plus the ghistoryBits GHR, see
+// predictor_storage(). With 13 index bits that is 8 * 14 * 2^13 + 13 = 917517 bits; the 16 Kbits + 256 bits
+// budget allows 2^7 rows, custom:13:7:29 is 8 * 14 * 2^7 + 13 = 14349 bits
 // Based on the paper, the suggested theta is floor(1.93 * ghistoryBits + 14) = 39, however after simple tuning
 // the best theta found is 29
 
 //------------------------------------//
-//        Predictor Functions         //
+//    Predictor Instance Functions    //
 //------------------------------------//
 
-// Initialize the predictor
+// Parse a predictor spec "static", "gshare:<g>",
+// "tournament:<g>:<l>:<i>", "custom",
+// "custom:<# history>:<# index>:<theta>", "tage" or
+// "tage:<# tables>:<# index>:<# tag>:<min history>:<max history>"
+// into 'config'
+//
+// Returns True if Successful
+//
+int
+predictor_parse_config(const char *spec, predictor_config_t *config) {
+    memset(config, 0, sizeof(predictor_config_t));
+    config->layout = DEFAULT_LAYOUT;
+    if (!strcmp(spec, "static")) {
+        config->bpType = STATIC;
+    } else if (!strncmp(spec, "gshare:", 7)) {
+        config->bpType = GSHARE;
+        return sscanf(spec + 7, "%d", &config->ghistoryBits) == 1 &&
+               config->ghistoryBits > 0 && config->ghistoryBits <= MAX_TABLE_BITS;
+    } else if (!strncmp(spec, "tournament:", 11)) {
+        config->bpType = TOURNAMENT;
+        return sscanf(spec + 11, "%d:%d:%d", &config->ghistoryBits,
+                      &config->lhistoryBits, &config->pcIndexBits) == 3 &&
+               config->ghistoryBits > 0 && config->ghistoryBits <= MAX_TABLE_BITS &&
+               config->lhistoryBits > 0 && config->lhistoryBits <= MAX_TABLE_BITS &&
+               config->pcIndexBits > 0 && config->pcIndexBits <= MAX_TABLE_BITS;
+    } else if (!strcmp(spec, "custom")) {
+        config->bpType = CUSTOM;
+        config->ghistoryBits = 13;
+        config->pcIndexBits = 13;
+        config->theta = 29;
+    } else if (!strncmp(spec, "custom:", 7)) {
+        config->bpType = CUSTOM;
+        return sscanf(spec + 7, "%d:%d:%d", &config->ghistoryBits,
+                      &config->pcIndexBits, &config->theta) == 3 &&
+               config->ghistoryBits > 0 && config->ghistoryBits <= PERCEPTRON_MAX_HISTORY &&
+               config->pcIndexBits > 0 && config->pcIndexBits <= MAX_TABLE_BITS && config->theta >= 0;
+    } else if (!strcmp(spec, "tage")) {
+        config->bpType = TAGE;
+        config->tageTables = TAGE_TABLES;
+        config->pcIndexBits = TAGE_INDEX_BITS;
+        config->tagBits = TAGE_TAG_BITS;
+        config->minHistory = TAGE_MIN_HISTORY;
+        config->ghistoryBits = TAGE_MAX_LENGTH;
+    } else if (!strncmp(spec, "tage:", 5)) {
+        config->bpType = TAGE;
+        return sscanf(spec + 5, "%d:%d:%d:%d:%d", &config->tageTables, &config->pcIndexBits,
+                      &config->tagBits, &config->minHistory, &config->ghistoryBits) == 5 &&
+               config->tageTables > 0 && config->tageTables <= TAGE_MAX_TABLES &&
+               config->pcIndexBits > 0 && config->pcIndexBits <= TAGE_MAX_INDEX &&
+               config->tagBits > 1 && config->tagBits <= TAGE_MAX_TAG &&
+               config->minHistory > 0 && config->minHistory <= config->ghistoryBits &&
+               config->ghistoryBits <= TAGE_MAX_HISTORY;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Write the spec of 'config' to 'buf', the inverse of predictor_parse_config
 //
 void
-init_predictor() {
+predictor_config_name(const predictor_config_t *config, char *buf, size_t len) {
+    switch (config->bpType) {
+        case GSHARE:
+            snprintf(buf, len, "gshare:%d", config->ghistoryBits);
+            break;
+        case TOURNAMENT:
+            snprintf(buf, len, "tournament:%d:%d:%d", config->ghistoryBits,
+                     config->lhistoryBits, config->pcIndexBits);
+            break;
+        case CUSTOM:
+            if (config->ghistoryBits == 13 && config->pcIndexBits == 13 && config->theta == 29) {
+                snprintf(buf, len, "custom");
+            } else {
+                snprintf(buf, len, "custom:%d:%d:%d", config->ghistoryBits,
+                         config->pcIndexBits, config->theta);
+            }
+            break;
+        case TAGE:
+            if (config->tageTables == TAGE_TABLES && config->pcIndexBits == TAGE_INDEX_BITS &&
+                config->tagBits == TAGE_TAG_BITS && config->minHistory == TAGE_MIN_HISTORY &&
+                config->ghistoryBits == TAGE_MAX_LENGTH) {
+                snprintf(buf, len, "tage");
+            } else {
+                snprintf(buf, len, "tage:%d:%d:%d:%d:%d", config->tageTables, config->pcIndexBits,
+                         config->tagBits, config->minHistory, config->ghistoryBits);
+            }
+            break;
+        default:
+            snprintf(buf, len, "static");
+            break;
+    }
+}
+
+// add a table of 'entries' entries of 'width' bits to 'storage'
+static void
+add_storage(predictor_storage_t *storage, const char *name, uint64_t entries, int width) {
+    storage_item_t *item = &storage->items[storage->count++];
+    item->name = name;
+    item->entries = entries;
+    item->width = width;
+    item->bits = entries * width;
+    storage->bits += item->bits;
+}
+
+// Fill 'storage' with every table and register of a predictor with
+// 'config', each entry at its real width
+//
+void
+predictor_storage(const predictor_config_t *config, predictor_storage_t *storage) {
+    memset(storage, 0, sizeof(predictor_storage_t));
+    switch (config->bpType) {
+        case GSHARE:
+            add_storage(storage, "global counters", (uint64_t) 1 << config->ghistoryBits, 2);
+            add_storage(storage, "ghr", 1, config->ghistoryBits);
+            break;
+        case TOURNAMENT:
+            add_storage(storage, "global counters", (uint64_t) 1 << config->ghistoryBits, 2);
+            add_storage(storage, "selectors", (uint64_t) 1 << config->ghistoryBits, 2);
+            add_storage(storage, "local histories", (uint64_t) 1 << config->pcIndexBits, config->lhistoryBits);
+            add_storage(storage, "local counters", (uint64_t) 1 << config->lhistoryBits, 2);
+            add_storage(storage, "ghr", 1, config->ghistoryBits);
+            break;
+        case CUSTOM:
+            // one row of ghistoryBits + 1 weights per index, weight 0 is the bias
+            add_storage(storage, "weights", ((uint64_t) 1 << config->pcIndexBits) * (config->ghistoryBits + 1),
+                        PERCEPTRON_WEIGHT_BITS);
+            add_storage(storage, "ghr", 1, config->ghistoryBits);
+            break;
+        case TAGE:
+            add_storage(storage, "base counters", (uint64_t) 1 << (config->pcIndexBits + 2), TAGE_BASE_BITS);
+            add_storage(storage, "tagged entries", (uint64_t) config->tageTables << config->pcIndexBits,
+                        TAGE_CTR_BITS + config->tagBits + TAGE_U_BITS);
+            add_storage(storage, "ghr", 1, config->ghistoryBits);
+            // index, tag and narrower tag folds of every table
+            add_storage(storage, "folded histories", config->tageTables,
+                        config->pcIndexBits + 2 * config->tagBits - 1);
+            add_storage(storage, "use_alt_on_na", 1, TAGE_USE_ALT_BITS);
+            add_storage(storage, "reset tick", 1, TAGE_TICK_BITS);
+            break;
+        default:
+            break;
+    }
+}
+
+// Storage of a predictor with 'config' in bits
+//
+uint64_t
+predictor_config_bits(const predictor_config_t *config) {
+    predictor_storage_t storage;
+    predictor_storage(config, &storage);
+    return storage.bits;
+}
+
+//------------------------------------//
+//          Table Accessors           //
+//------------------------------------//
+
+// 'packed' is a constant in every caller that runs per branch, so each
+// accessor compiles down to the code for one layout
+
+static inline uint8_t
+read_counter(const uint8_t *table, uint32_t index, int packed) {
+    return packed ? get_counter(table, index) : table[index];
+}
+
+static inline void
+write_counter(uint8_t *table, uint32_t index, uint8_t value, int packed) {
+    if (packed) {
+        set_counter(table, index, value);
+    } else {
+        table[index] = value;
+    }
+}
+
+// local history 'index' of the pht, 'lhistoryBits' wide
+static inline uint32_t
+read_pattern(const predictor_t *p, uint32_t index, int lhistoryBits, int packed) {
+    return packed ? get_history(p->phtBits, index, lhistoryBits) : p->pht[index] & left_shift(lhistoryBits);
+}
+
+static inline void
+write_pattern(predictor_t *p, uint32_t index, uint32_t value, int lhistoryBits, int packed) {
+    if (packed) {
+        set_history(p->phtBits, index, lhistoryBits, value);
+    } else {
+        p->pht[index] = value;
+    }
+}
+
+// address of counter 'index', for prefetching
+static inline const uint8_t *
+counter_address(const uint8_t *table, uint32_t index, int packed) {
+    return packed ? table + (index >> 2) : table + index;
+}
+
+// The tournament global counter and selector of one ghr index are
+// always used together, so they are stored as one entry: counters 2i
+// and 2i+1 of ghistoryBuffer, in the same byte with LAYOUT_PACKED.
+// Build with -DSPLIT_SELECTOR to keep two tables, for comparisons.
+#ifdef SPLIT_SELECTOR
+#define TOURNAMENT_ENTRIES       1
+#define GLOBAL_ENTRY(index)      (index)
+#define SELECTOR_ENTRY(index)    (index)
+#else
+#define TOURNAMENT_ENTRIES       2
+#define GLOBAL_ENTRY(index)      ((index) << 1)
+#define SELECTOR_ENTRY(index)    (((index) << 1) | 1)
+#endif
+
+static inline size_t
+counter_bytes(uint32_t entries, int packed) {
+    return packed ? packed_counter_bytes(entries) : entries;
+}
+
+// arena bytes of the instance and every table for 'config'
+static size_t
+arena_bytes(const predictor_config_t *config, int packed) {
+    size_t bytes = arena_round(sizeof(predictor_t));
+    uint32_t ghrSize = power(config->ghistoryBits);
+    uint32_t phtSize = power(config->pcIndexBits);
+    switch (config->bpType) {
+        case CUSTOM:
+            bytes += arena_round((size_t) phtSize * perceptron_stride(config->ghistoryBits + 1));
+            break;
+        case TOURNAMENT:
+            bytes += arena_round(packed ? packed_history_bytes(phtSize, config->lhistoryBits)
+                                        : phtSize * sizeof(uint32_t));
+            bytes += arena_round(counter_bytes(power(config->lhistoryBits), packed));
+            bytes += arena_round(counter_bytes(ghrSize * TOURNAMENT_ENTRIES, packed));
+#ifdef SPLIT_SELECTOR
+            bytes += arena_round(counter_bytes(ghrSize, packed));
+#endif
+            break;
+        case GSHARE:
+            bytes += arena_round(counter_bytes(ghrSize, packed));
+            break;
+        case TAGE:
+            bytes += tage_arena_bytes(config->tageTables, config->pcIndexBits);
+            break;
+        default:
+            break;
+    }
+    return bytes;
+}
+
+// take 'entries' 2-bit counters initialized to WN from the arena
+static uint8_t *
+alloc_counters(arena_t *arena, uint32_t entries, int packed) {
+    uint8_t *table = (uint8_t *) arena_alloc(arena, counter_bytes(entries, packed));
+    if (packed) {
+        init_packed_counter(table, entries);
+    } else {
+        init_counter(table, entries);
+    }
+    return table;
+}
+
+// Create a predictor instance for 'config', the instance and all of
+// its tables are one arena
+//
+predictor_t *
+predictor_create(const predictor_config_t *config) {
+    int packed = config->layout == LAYOUT_PACKED;
+    arena_t arena;
+    if (!arena_init(&arena, arena_bytes(config, packed), config->pages)) {
+        return NULL;
+    }
+    predictor_t *p = (predictor_t *) arena_alloc(&arena, sizeof(predictor_t));
+    p->config = *config;
+
     // init predictor based on bpType
-    switch (bpType) {
+    switch (p->config.bpType) {
         case CUSTOM:
-            ghistoryBits = 13;
-            theta = 29;
-            ghr = 0;
-            ghrMask = left_shift(ghistoryBits);
-            ghrSize = power(ghistoryBits);
-            init_perceptronTable(ghrSize, ghistoryBits, &perceptronTable);
+            p->perceptronMask = left_shift(p->config.pcIndexBits);
+            p->perceptronStride = perceptron_stride(p->config.ghistoryBits + 1);
+            p->perceptronTable = (int8_t *) arena_alloc(&arena, (size_t) power(p->config.pcIndexBits) *
+                                                                p->perceptronStride);
+            init_perceptron_history(p->perceptronHistory);
             break;
         case TOURNAMENT:
             // init local predictor
-            phtMask = left_shift(lhistoryBits);
-            phtSize = power(pcIndexBits);
-            pcIndexMask = left_shift(pcIndexBits);
-            pht = (uint32_t *) malloc(phtSize * sizeof(uint32_t));
-
-            lptSize = power(lhistoryBits);
-            lpredictionTable = (uint8_t *) malloc(lptSize * sizeof(uint8_t));
-
-            // init predictor selector
-            ghrSize = power(ghistoryBits);
-            selectorBuffer = (uint8_t *) malloc(ghrSize * sizeof(uint8_t));
-
-            // global predictor can be init using the following
-            init_counter(selectorBuffer, ghrSize);
-            init_table(pht, phtSize);
-            init_counter(lpredictionTable, lptSize);
+            p->phtMask = left_shift(p->config.lhistoryBits);
+            p->phtSize = power(p->config.pcIndexBits);
+            p->pcIndexMask = left_shift(p->config.pcIndexBits);
+            if (packed) {
+                p->phtBits = (uint8_t *) arena_alloc(&arena, packed_history_bytes(p->phtSize, p->config.lhistoryBits));
+            } else {
+                p->pht = (uint32_t *) arena_alloc(&arena, p->phtSize * sizeof(uint32_t));
+            }
+
+            p->lptSize = power(p->config.lhistoryBits);
+            p->lpredictionTable = alloc_counters(&arena, p->lptSize, packed);
+
+            // init global predictor and selector
+            p->ghr = 0;
+            p->ghrMask = left_shift(p->config.ghistoryBits);
+            p->ghrSize = power(p->config.ghistoryBits);
+            p->ghistoryBuffer = alloc_counters(&arena, p->ghrSize * TOURNAMENT_ENTRIES, packed);
+#ifdef SPLIT_SELECTOR
+            p->selectorBuffer = alloc_counters(&arena, p->ghrSize, packed);
+#else
+            p->selectorBuffer = p->ghistoryBuffer;
+#endif
+            break;
         case GSHARE:
-            ghr = 0;
-            ghrMask = left_shift(ghistoryBits);
-            ghrSize = power(ghistoryBits);
-            ghistoryBuffer = (uint8_t *) malloc(ghrSize * sizeof(uint8_t));
-            init_counter(ghistoryBuffer, ghrSize);
+            p->ghr = 0;
+            p->ghrMask = left_shift(p->config.ghistoryBits);
+            p->ghrSize = power(p->config.ghistoryBits);
+            p->ghistoryBuffer = alloc_counters(&arena, p->ghrSize, packed);
+            break;
+        case TAGE:
+            p->tage = tage_create(&arena, p->config.tageTables, p->config.pcIndexBits, p->config.tagBits,
+                                  p->config.minHistory, p->config.ghistoryBits);
+            break;
+        default:
+            break;
+    }
+
+#ifdef INSTRUMENT
+    p->inst = instrument_create();
+    switch (p->config.bpType) {
+        case GSHARE:
+            instrument_table(p->inst, "ghistoryBuffer", p->ghrSize, 1);
+            break;
+        case TOURNAMENT:
+            instrument_table(p->inst, "ghistoryBuffer", p->ghrSize, 1);
+            instrument_table(p->inst, "pht", p->phtSize, 0);
+            instrument_table(p->inst, "lpredictionTable", p->lptSize, 1);
+            break;
+        case CUSTOM:
+            instrument_table(p->inst, "perceptronTable", power(p->config.pcIndexBits), 0);
             break;
         default:
             break;
     }
+#endif
+
+    if (!p->config.generic) {
+        p->batch = find_kernel(&p->config);
+    }
+    p->arena = arena;
+    return p;
 }
 
-// Make a prediction for conditional branch instruction at PC 'pc'
-// Returning TAKEN indicates a prediction of taken; returning NOTTAKEN
-// indicates a prediction of not taken
+// Configuration actually used by 'p'
+//
+const predictor_config_t *
+predictor_get_config(const predictor_t *p) {
+    return &p->config;
+}
+
+//------------------------------------//
+//      Fused Lookup and Update       //
+//------------------------------------//
+
+// Each lookup reads every table entry the branch needs once and keeps
+// it in the context, the matching update writes the new values back
+// without reading the tables again. The history is passed in and the
+// updated history returned, so the batch loops can keep it in a local.
+// Widths and masks are parameters for the same reason as 'packed'.
+
+static inline uint8_t
+gshare_lookup(const predictor_t *p, uint32_t pc, uint32_t ghr, uint32_t ghrMask,
+              int packed, predictor_lookup_t *ctx) {
+    ctx->gindex = xor_ghr_pc_to_index(pc, ghr, ghrMask);
+    ctx->globalPrediction = read_counter(p->ghistoryBuffer, ctx->gindex, packed);
+
+    // the counter is always written back, so the write is recorded here
+    INSTRUMENT_HOOK(instrument_read(&p->inst->tables[STATS_GLOBAL], ctx->gindex, pc, ctx->globalPrediction));
+    INSTRUMENT_HOOK(instrument_write(&p->inst->tables[STATS_GLOBAL], ctx->gindex, pc));
+    return ctx->prediction = parse_prediction_entry(ctx->globalPrediction);
+}
+
+static inline uint32_t
+gshare_update(predictor_t *p, const predictor_lookup_t *ctx, uint8_t outcome,
+              uint32_t ghr, uint32_t ghrMask, int packed) {
+    write_counter(p->ghistoryBuffer, ctx->gindex, next_state(ctx->globalPrediction, outcome), packed);
+    return ((ghr << 1) | outcome) & ghrMask;
+}
+
+static inline uint8_t
+tournament_lookup(const predictor_t *p, uint32_t pc, uint32_t ghr, uint32_t ghrMask,
+                  int lhistoryBits, uint32_t pcIndexMask, int packed, predictor_lookup_t *ctx) {
+    ctx->gindex = hash_ghr_to_index(ghr, ghrMask);
+    ctx->lindex = hash_pc_to_index(pc, pcIndexMask);
+    ctx->localPattern = read_pattern(p, ctx->lindex, lhistoryBits, packed);
+    ctx->localPrediction = read_counter(p->lpredictionTable, ctx->localPattern, packed);
+    ctx->globalPrediction = read_counter(p->ghistoryBuffer, GLOBAL_ENTRY(ctx->gindex), packed);
+    ctx->choice = read_counter(p->selectorBuffer, SELECTOR_ENTRY(ctx->gindex), packed);
+
+    // all three entries are always written back
+    INSTRUMENT_HOOK(instrument_read(&p->inst->tables[STATS_GLOBAL], ctx->gindex, pc, ctx->globalPrediction));
+    INSTRUMENT_HOOK(instrument_write(&p->inst->tables[STATS_GLOBAL], ctx->gindex, pc));
+    INSTRUMENT_HOOK(instrument_read(&p->inst->tables[STATS_PHT], ctx->lindex, pc, 0));
+    INSTRUMENT_HOOK(instrument_write(&p->inst->tables[STATS_PHT], ctx->lindex, pc));
+    INSTRUMENT_HOOK(instrument_read(&p->inst->tables[STATS_LOCAL], ctx->localPattern, pc, ctx->localPrediction));
+    INSTRUMENT_HOOK(instrument_write(&p->inst->tables[STATS_LOCAL], ctx->localPattern, pc));
+
+    // the next ghr index is 2k or 2k+1, both entries share a cache line
+    uint32_t next = hash_ghr_to_index(ghr << 1, ghrMask);
+    prefetch(counter_address(p->ghistoryBuffer, GLOBAL_ENTRY(next), packed));
+
+    // predict with the component picked by the selector
+    uint8_t counter = (parse_prediction_entry(ctx->choice) == LC) ? ctx->localPrediction
+                                                                   : ctx->globalPrediction;
+    return ctx->prediction = parse_prediction_entry(counter);
+}
+
+static inline uint32_t
+tournament_update(predictor_t *p, const predictor_lookup_t *ctx, uint8_t outcome,
+                  uint32_t ghr, uint32_t ghrMask, int lhistoryBits, int packed) {
+    // train both components and the local history
+    write_counter(p->lpredictionTable, ctx->localPattern, next_state(ctx->localPrediction, outcome), packed);
+    write_pattern(p, ctx->lindex, ((ctx->localPattern << 1) | outcome) & left_shift(lhistoryBits),
+                  lhistoryBits, packed);
+    write_counter(p->ghistoryBuffer, GLOBAL_ENTRY(ctx->gindex), next_state(ctx->globalPrediction, outcome), packed);
+
+    // check local and global prediction result and update selector
+    uint8_t lpredictionRes = parse_prediction_entry(ctx->localPrediction) ^ outcome;
+    uint8_t gpredictionRes = parse_prediction_entry(ctx->globalPrediction) ^ outcome;
+    INSTRUMENT_HOOK(instrument_choice(p->inst, parse_prediction_entry(ctx->choice) == LC,
+                                      !lpredictionRes, !gpredictionRes));
+
+    // if gpredictionRes < lpredictionRes, favor global, otherwise local
+    if (gpredictionRes < lpredictionRes) {
+        write_counter(p->selectorBuffer, SELECTOR_ENTRY(ctx->gindex), next_state(ctx->choice, CHOOSEGL), packed);
+    } else if (gpredictionRes > lpredictionRes) {
+        write_counter(p->selectorBuffer, SELECTOR_ENTRY(ctx->gindex), next_state(ctx->choice, CHOOSELC), packed);
+    }// else does not change selector
+
+    return ((ghr << 1) | outcome) & ghrMask;
+}
+
+// the row is indexed by pc xor the recent history, the dot product is
+// kept so training does not compute it again
+static inline uint8_t
+custom_lookup(const predictor_t *p, uint32_t pc, int length, uint32_t rowMask,
+              predictor_lookup_t *ctx) {
+    const uint64_t *xbits = p->perceptronHistory;
+    uint32_t index = xor_ghr_pc_to_index(pc, (uint32_t) (xbits[0] >> 1), rowMask);
+    ctx->row = p->perceptronTable + (size_t) index * perceptron_stride(length);
+    INSTRUMENT_HOOK(ctx->pc = pc);
+    INSTRUMENT_HOOK(instrument_read(&p->inst->tables[STATS_GLOBAL], index, pc, 0));
+    ctx->yout = perceptron_dot(ctx->row, xbits, length);
+    return ctx->prediction = (ctx->yout >= 0) ? TAKEN : NOTTAKEN;
+}
+
+// train when wrong or not confident, then shift in the outcome
+static inline void
+custom_update(predictor_t *p, const predictor_lookup_t *ctx, uint8_t outcome, int length) {
+    if (ctx->prediction != outcome || abs(ctx->yout) <= p->config.theta) {
+        perceptron_train(ctx->row, p->perceptronHistory, length, outcome);
+        INSTRUMENT_HOOK(instrument_write(&p->inst->tables[STATS_GLOBAL],
+                                         (uint32_t) ((ctx->row - p->perceptronTable) / perceptron_stride(length)),
+                                         ctx->pc));
+    }
+    perceptron_shift_history(p->perceptronHistory, length, outcome);
+}
+
+// Predict the branch at PC 'pc' with instance 'p' and fill 'ctx' for
+// predictor_update()
 //
 uint8_t
-make_prediction(uint32_t pc) {
-    // Make a prediction based on the bpType
-    uint32_t gindex = 0;
-    uint32_t lindex = 0;
-    uint32_t localPattern = 0;
-    switch (bpType) {
+predictor_lookup(predictor_t *p, uint32_t pc, predictor_lookup_t *ctx) {
+    int packed = p->config.layout == LAYOUT_PACKED;
+    ctx->pc = pc;
+    switch (p->config.bpType) {
         case STATIC:
-            return TAKEN;
+            return ctx->prediction = TAKEN;
         case GSHARE:
-            gindex = xor_ghr_pc_to_index(pc, ghr, ghrMask);
-            return parse_prediction_entry(ghistoryBuffer[gindex]);
-        case CUSTOM:
-            gindex = xor_ghr_pc_to_index(pc, ghr, ghrMask);
-            return parse_perceptron_entry(ghr, ghistoryBits, perceptronTable[gindex]);
+            return gshare_lookup(p, pc, p->ghr, p->ghrMask, packed, ctx);
         case TOURNAMENT:
-            // query selector to choose local or global
-            if (bpType == TOURNAMENT) {
-                gindex = hash_ghr_to_index(ghr, ghrMask);
-            }
-            uint8_t choice = parse_prediction_entry(selectorBuffer[gindex]);
-            switch (choice) {
-                case LC:
-                    lindex = hash_pc_to_index(pc, pcIndexMask);
-                    lindex = pht[lindex] & phtMask; // get the local pattern as index
-                    return parse_prediction_entry(lpredictionTable[lindex]);
-                default:
-                    // global predictor
-                    return parse_prediction_entry(ghistoryBuffer[gindex]);
-            }
+            return tournament_lookup(p, pc, p->ghr, p->ghrMask, p->config.lhistoryBits,
+                                     p->pcIndexMask, packed, ctx);
+        case CUSTOM:
+            return custom_lookup(p, pc, p->config.ghistoryBits + 1, p->perceptronMask, ctx);
+        case TAGE:
+            return ctx->prediction = tage_lookup(p->tage, pc, &ctx->tage);
         default:
             break;
     }
 
     // If there is not a compatable bpType then return NOTTAKEN
-    return NOTTAKEN;
+    return ctx->prediction = NOTTAKEN;
 }
 
-// Train the predictor the last executed branch at PC 'pc' and with
-// outcome 'outcome' (true indicates that the branch was taken, false
-// indicates that the branch was not taken)
+// Train instance 'p' with the outcome of the branch looked up in 'ctx'
 //
 void
-train_predictor(uint32_t pc, uint8_t outcome) {
-    // update predictor based on bpType
-    uint32_t index = 0;
-    // update tournament
-    uint32_t lindex = 0;
-    uint32_t localPattern = 0;
-    uint8_t localPrediction = 0;
-    uint8_t lpredictionRes = 0;
-    uint8_t gpredictionRes = 0;
-    uint8_t globalPrediction = 0;
-
-    uint8_t choice = 0;
-    switch (bpType) {
+predictor_update(predictor_t *p, const predictor_lookup_t *ctx, uint8_t outcome) {
+    int packed = p->config.layout == LAYOUT_PACKED;
+    switch (p->config.bpType) {
         case GSHARE:
-            // update global history buffer
-            index = xor_ghr_pc_to_index(pc, ghr, ghrMask);
-            ghistoryBuffer[index] = next_state(ghistoryBuffer[index], outcome);
-            ghr = ((ghr << 1) | outcome) & ghrMask;
+            p->ghr = gshare_update(p, ctx, outcome, p->ghr, p->ghrMask, packed);
+            break;
+        case TOURNAMENT:
+            p->ghr = tournament_update(p, ctx, outcome, p->ghr, p->ghrMask,
+                                       p->config.lhistoryBits, packed);
             break;
         case CUSTOM:
-            index = xor_ghr_pc_to_index(pc, ghr, ghrMask);
-            int32_t signed_outcome = (outcome == TAKEN) ? 1 : -1;
-            train_perceptron(ghistoryBits, ghr, signed_outcome, perceptronTable[index], index);
-            ghr = ((ghr << 1) | outcome) & ghrMask;
+            custom_update(p, ctx, outcome, p->config.ghistoryBits + 1);
             break;
-        case TOURNAMENT:
-            // check current selector:
+        case TAGE:
+            tage_update(p->tage, &ctx->tage, outcome);
+            break;
+        default:
+            break;
+    }
+}
 
-            // Train local predictor
-            lindex = hash_pc_to_index(pc, pcIndexMask);
-            localPattern = pht[lindex] & phtMask;
-            localPrediction = lpredictionTable[localPattern];
+// Make a prediction with instance 'p' for conditional branch
+// instruction at PC 'pc'
+//
+uint8_t
+predictor_predict(predictor_t *p, uint32_t pc) {
+    predictor_lookup_t ctx;
+    return predictor_lookup(p, pc, &ctx);
+}
 
-            // update local 2-bit counter
-            lpredictionTable[localPattern] = next_state(localPrediction, outcome);
+// Train instance 'p' with the last executed branch at PC 'pc' and
+// with outcome 'outcome'
+//
+void
+predictor_train(predictor_t *p, uint32_t pc, uint8_t outcome) {
+    predictor_lookup_t ctx;
+    predictor_lookup(p, pc, &ctx);
+    predictor_update(p, &ctx, outcome);
+}
 
-            // update local pattern in pht
-            pht[lindex] = ((localPattern << 1) | outcome) & phtMask;
+//------------------------------------//
+//         Batched Predictors         //
+//------------------------------------//
 
-            // Train Global Predictor
-            // update global 2-bit counter
-            if (bpType == TOURNAMENT) {
-                index = hash_ghr_to_index(ghr, ghrMask);
-            }
-            globalPrediction = ghistoryBuffer[index];
-            ghistoryBuffer[index] = next_state(globalPrediction, outcome);
+// Each loop runs the fused lookup and update per branch, keeps the
+// history in a local for the whole batch and only writes it back at
+// the end
+
+static uint32_t
+batch_static(const uint8_t *outcomes, size_t n, uint8_t *mispredict_out) {
+    uint32_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t miss = outcomes[i] ^ TAKEN;
+        total += miss;
+        if (mispredict_out != NULL) {
+            mispredict_out[i] = miss;
+        }
+    }
+    return total;
+}
 
-            // update ghr
-            ghr = ((ghr << 1) | outcome) & ghrMask;
+// The loops below take every width and mask as a parameter. The generic
+// batch_* functions pass the values of the instance, the specialized
+// kernels generated from kernels.def pass compile-time constants so the
+// masks, table sizes and history length fold into the code.
+
+static inline uint32_t
+gshare_loop(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+            size_t n, uint8_t *mispredict_out, const uint32_t mask, const int packed) {
+    uint32_t ghr = p->ghr;
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        predictor_lookup_t ctx;
+        uint8_t miss = gshare_lookup(p, pcs[i], ghr, mask, packed, &ctx) ^ outcomes[i];
+        total += miss;
+        if (mispredict_out != NULL) {
+            mispredict_out[i] = miss;
+        }
+        ghr = gshare_update(p, &ctx, outcomes[i], ghr, mask, packed);
+    }
+
+    p->ghr = ghr;
+    return total;
+}
+
+static uint32_t
+batch_gshare(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+             size_t n, uint8_t *mispredict_out) {
+    if (p->config.layout == LAYOUT_PACKED) {
+        return gshare_loop(p, pcs, outcomes, n, mispredict_out, p->ghrMask, 1);
+    }
+    return gshare_loop(p, pcs, outcomes, n, mispredict_out, p->ghrMask, 0);
+}
 
-            // check local and global prediction result and update selector
-            lpredictionRes = parse_prediction_entry(localPrediction) ^ outcome;
-            gpredictionRes = parse_prediction_entry(globalPrediction) ^ outcome;
+static inline uint32_t
+tournament_loop(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+                size_t n, uint8_t *mispredict_out, const uint32_t ghrMask,
+                const int lhistoryBits, const uint32_t pcIndexMask, const int packed) {
+    uint32_t ghr = p->ghr;
+    uint32_t total = 0;
 
-            // if gpredictionRes < lpredictionRes, favor global, otherwise local
-            if (gpredictionRes < lpredictionRes) {
-                selectorBuffer[index] = next_state(selectorBuffer[index], CHOOSEGL);
-            } else if (gpredictionRes > lpredictionRes) {
-                selectorBuffer[index] = next_state(selectorBuffer[index], CHOOSELC);
-            }// else does not change selector
+    for (size_t i = 0; i < n; i++) {
+        // the local history of the next branch only depends on its pc
+        if (i + 1 < n) {
+            uint32_t next = hash_pc_to_index(pcs[i + 1], pcIndexMask);
+            prefetch(packed ? p->phtBits + (size_t) next * lhistoryBits / 8 : (uint8_t *) (p->pht + next));
+        }
+
+        predictor_lookup_t ctx;
+        uint8_t miss = tournament_lookup(p, pcs[i], ghr, ghrMask, lhistoryBits, pcIndexMask,
+                                         packed, &ctx) ^ outcomes[i];
+        total += miss;
+        if (mispredict_out != NULL) {
+            mispredict_out[i] = miss;
+        }
+        ghr = tournament_update(p, &ctx, outcomes[i], ghr, ghrMask, lhistoryBits, packed);
+    }
+
+    p->ghr = ghr;
+    return total;
+}
+
+static uint32_t
+batch_tournament(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+                 size_t n, uint8_t *mispredict_out) {
+    if (p->config.layout == LAYOUT_PACKED) {
+        return tournament_loop(p, pcs, outcomes, n, mispredict_out, p->ghrMask,
+                               p->config.lhistoryBits, p->pcIndexMask, 1);
+    }
+    return tournament_loop(p, pcs, outcomes, n, mispredict_out, p->ghrMask,
+                           p->config.lhistoryBits, p->pcIndexMask, 0);
+}
+
+static inline uint32_t
+custom_loop(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+            size_t n, uint8_t *mispredict_out, const int ghistoryBits, const uint32_t rowMask) {
+    const int length = ghistoryBits + 1;
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        predictor_lookup_t ctx;
+        uint8_t miss = custom_lookup(p, pcs[i], length, rowMask, &ctx) ^ outcomes[i];
+        total += miss;
+        if (mispredict_out != NULL) {
+            mispredict_out[i] = miss;
+        }
+        custom_update(p, &ctx, outcomes[i], length);
+    }
+
+    return total;
+}
+
+static uint32_t
+batch_custom(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+             size_t n, uint8_t *mispredict_out) {
+    return custom_loop(p, pcs, outcomes, n, mispredict_out, p->config.ghistoryBits, p->perceptronMask);
+}
+
+static uint32_t
+batch_tage(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+           size_t n, uint8_t *mispredict_out) {
+    uint32_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        tage_lookup_t ctx;
+        uint8_t miss = tage_lookup(p->tage, pcs[i], &ctx) ^ outcomes[i];
+        total += miss;
+        if (mispredict_out != NULL) {
+            mispredict_out[i] = miss;
+        }
+        tage_update(p->tage, &ctx, outcomes[i]);
+    }
+    return total;
+}
+
+//------------------------------------//
+//        Specialized Kernels         //
+//------------------------------------//
+
+// One function per layout is generated for every entry of KERNEL_LIST,
+// and predictor_create() installs the one matching the configuration.
+// Build with -DKERNEL_LIST='"<file>"' to specialize a different set.
+#ifndef KERNEL_LIST
+#define KERNEL_LIST "kernels.def"
+#endif
+
+#define SPECIALIZE_GSHARE(g) \
+    static uint32_t gshare_##g##_byte(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes, \
+                                      size_t n, uint8_t *mispredict_out) { \
+        return gshare_loop(p, pcs, outcomes, n, mispredict_out, left_shift(g), 0); \
+    } \
+    static uint32_t gshare_##g##_packed(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes, \
+                                        size_t n, uint8_t *mispredict_out) { \
+        return gshare_loop(p, pcs, outcomes, n, mispredict_out, left_shift(g), 1); \
+    }
+#define SPECIALIZE_TOURNAMENT(g, l, i) \
+    static uint32_t tournament_##g##_##l##_##i##_byte(predictor_t *p, const uint32_t *pcs, \
+                                                      const uint8_t *outcomes, size_t n, \
+                                                      uint8_t *mispredict_out) { \
+        return tournament_loop(p, pcs, outcomes, n, mispredict_out, left_shift(g), l, left_shift(i), 0); \
+    } \
+    static uint32_t tournament_##g##_##l##_##i##_packed(predictor_t *p, const uint32_t *pcs, \
+                                                        const uint8_t *outcomes, size_t n, \
+                                                        uint8_t *mispredict_out) { \
+        return tournament_loop(p, pcs, outcomes, n, mispredict_out, left_shift(g), l, left_shift(i), 1); \
+    }
+#define SPECIALIZE_CUSTOM(h, i) \
+    static uint32_t custom_##h##_##i##_byte(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes, \
+                                            size_t n, uint8_t *mispredict_out) { \
+        return custom_loop(p, pcs, outcomes, n, mispredict_out, h, left_shift(i)); \
+    }
+#include KERNEL_LIST
+#undef SPECIALIZE_GSHARE
+#undef SPECIALIZE_TOURNAMENT
+#undef SPECIALIZE_CUSTOM
+
+// the perceptron tables have no packed layout, both entries are the same
+static const kernel_t kernels[] = {
+#define SPECIALIZE_GSHARE(g) \
+    {GSHARE, g, 0, 0, gshare_##g##_byte, gshare_##g##_packed},
+#define SPECIALIZE_TOURNAMENT(g, l, i) \
+    {TOURNAMENT, g, l, i, tournament_##g##_##l##_##i##_byte, tournament_##g##_##l##_##i##_packed},
+#define SPECIALIZE_CUSTOM(h, i) \
+    {CUSTOM, h, 0, i, custom_##h##_##i##_byte, custom_##h##_##i##_byte},
+#include KERNEL_LIST
+#undef SPECIALIZE_GSHARE
+#undef SPECIALIZE_TOURNAMENT
+#undef SPECIALIZE_CUSTOM
+};
+
+// Specialized kernel for 'config', or NULL if there is none
+//
+static batch_fn
+find_kernel(const predictor_config_t *config) {
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        const kernel_t *kernel = &kernels[k];
+        if (kernel->bpType == config->bpType &&
+            kernel->ghistoryBits == config->ghistoryBits &&
+            kernel->lhistoryBits == config->lhistoryBits &&
+            kernel->pcIndexBits == config->pcIndexBits) {
+            return (config->layout == LAYOUT_PACKED) ? kernel->packed : kernel->byte;
+        }
+    }
+    return NULL;
+}
+
+// Predict and train 'n' branches in order
+//
+// Returns the number of mispredictions
+//
+uint32_t
+predict_and_train(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+                  size_t n, uint8_t *mispredict_out) {
+    if (p->batch != NULL) {
+        return p->batch(p, pcs, outcomes, n, mispredict_out);
+    }
+
+    switch (p->config.bpType) {
+        case STATIC:
+            return batch_static(outcomes, n, mispredict_out);
+        case GSHARE:
+            return batch_gshare(p, pcs, outcomes, n, mispredict_out);
+        case TOURNAMENT:
+            return batch_tournament(p, pcs, outcomes, n, mispredict_out);
+        case CUSTOM:
+            return batch_custom(p, pcs, outcomes, n, mispredict_out);
+        case TAGE:
+            return batch_tage(p, pcs, outcomes, n, mispredict_out);
+        default:
+            break;
+    }
+
+    // no compatible bpType, every branch is predicted NOTTAKEN
+    uint32_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += outcomes[i];
+        if (mispredict_out != NULL) {
+            mispredict_out[i] = outcomes[i];
+        }
+    }
+    return total;
+}
+
+// Shift 'n' branches into the histories of 'p' without touching the
+// tables
+//
+void
+predictor_skip(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes, size_t n) {
+    int packed = p->config.layout == LAYOUT_PACKED;
+    switch (p->config.bpType) {
+        case TOURNAMENT:
+            for (size_t i = 0; i < n; i++) {
+                uint32_t lindex = hash_pc_to_index(pcs[i], p->pcIndexMask);
+                uint32_t pattern = read_pattern(p, lindex, p->config.lhistoryBits, packed);
+                write_pattern(p, lindex, ((pattern << 1) | outcomes[i]) & p->phtMask,
+                              p->config.lhistoryBits, packed);
+            }
+            // the global history is shifted like gshare's
+            // fall through
+        case GSHARE:
+            for (size_t i = 0; i < n; i++) {
+                p->ghr = ((p->ghr << 1) | outcomes[i]) & p->ghrMask;
+            }
+            break;
+        case CUSTOM:
+            for (size_t i = 0; i < n; i++) {
+                perceptron_shift_history(p->perceptronHistory, p->config.ghistoryBits + 1, outcomes[i]);
+            }
+            break;
+        case TAGE:
+            tage_skip(p->tage, outcomes, n);
             break;
         default:
             break;
     }
 }
 
+// Name of the kernel used by predict_and_train() for 'p'
+//
+const char *
+predictor_kernel_name(const predictor_t *p) {
+    return (p->batch != NULL) ? "specialized" : "generic";
+}
+
+// Print the table statistics of 'p'
+//
+// Returns False if the build has no instrumentation (see -DINSTRUMENT)
+//
+int
+predictor_report(const predictor_t *p, FILE *out) {
+    if (p->inst == NULL) {
+        return 0;
+    }
+    char name[64];
+    predictor_config_name(&p->config, name, sizeof(name));
+    instrument_report(p->inst, out, name);
+    return 1;
+}
+
+// How the table arena of 'p' is backed, one of backingName
+//
+const char *
+predictor_backing_name(const predictor_t *p) {
+    return backingName[p->arena.backing];
+}
+
+// Free the instance and all of its tables, the arena holds the
+// instance itself so it is released from a copy
+//
+void
+predictor_destroy(predictor_t *p) {
+    if (p->inst != NULL) {
+        instrument_destroy(p->inst);
+    }
+    arena_t arena = p->arena;
+    arena_release(&arena);
+}
+
+//------------------------------------//
+//        Predictor Functions         //
+//------------------------------------//
+
+// Initialize the predictor
+//
+void
+init_predictor() {
+    predictor_config_t config;
+    memset(&config, 0, sizeof(predictor_config_t));
+    config.bpType = bpType;
+    config.ghistoryBits = ghistoryBits;
+    config.lhistoryBits = lhistoryBits;
+    config.pcIndexBits = pcIndexBits;
+    config.theta = theta;
+    config.layout = DEFAULT_LAYOUT;
+    if (bpType == CUSTOM && (ghistoryBits <= 0 || pcIndexBits <= 0)) {
+        // the tuned default custom predictor
+        predictor_parse_config("custom", &config);
+    }
+    if (bpType == TAGE) {
+        // the globals cannot describe the tagged tables
+        predictor_parse_config("tage", &config);
+    }
+    simd_init();
+    predictor = predictor_create(&config);
+
+    // keep the globals in sync with the configuration actually used
+    ghistoryBits = predictor->config.ghistoryBits;
+    pcIndexBits = predictor->config.pcIndexBits;
+    theta = predictor->config.theta;
+}
+
+// Make a prediction for conditional branch instruction at PC 'pc'
+// Returning TAKEN indicates a prediction of taken; returning NOTTAKEN
+// indicates a prediction of not taken
+//
+uint8_t
+make_prediction(uint32_t pc) {
+    lastLookupValid = 1;
+    return predictor_lookup(predictor, pc, &lastLookup);
+}
+
+// Train the predictor the last executed branch at PC 'pc' and with
+// outcome 'outcome' (true indicates that the branch was taken, false
+// indicates that the branch was not taken)
+//
+void
+train_predictor(uint32_t pc, uint8_t outcome) {
+    if (!lastLookupValid || lastLookup.pc != pc) {
+        predictor_lookup(predictor, pc, &lastLookup);
+    }
+    lastLookupValid = 0;
+    predictor_update(predictor, &lastLookup, outcome);
+}
+
 void destructor() {
-    free(ghistoryBuffer);
-    free(selectorBuffer);
-    free(pht);
-    free(lpredictionTable);
-    free(perceptronTable);
+    predictor_destroy(predictor);
+    predictor = NULL;
+    lastLookupValid = 0;
 }
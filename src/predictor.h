@@ -10,7 +10,9 @@
 #define PREDICTOR_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include "tage.h"
 
 //
 // Student Information
@@ -34,6 +36,7 @@ extern const char *email;
 #define GSHARE      1
 #define TOURNAMENT  2
 #define CUSTOM      3
+#define TAGE        4
 extern const char *bpName[];
 
 // Definitions for 2-bit counters
@@ -66,10 +69,143 @@ extern int pcIndexBits;  // Number of bits used for PC index
 extern int bpType;       // Branch Prediction Type
 extern int verbose;
 
+// Configuration of one predictor instance
+typedef struct {
+    int bpType;          // Branch Prediction Type
+    int ghistoryBits;    // Number of bits used for Global History
+    int lhistoryBits;    // Number of bits used for Local History
+    int pcIndexBits;     // Number of bits used for PC index
+    int32_t theta;       // perceptron training threshold
+    int tageTables;      // TAGE: number of tagged tables
+    int tagBits;         // TAGE: tag width
+    int minHistory;      // TAGE: shortest history, ghistoryBits is the longest
+    int layout;          // table layout, LAYOUT_BYTE or LAYOUT_PACKED
+    int generic;         // never use a specialized kernel (see kernels.def)
+    int pages;           // page policy of the table arena, see arena.h
+} predictor_config_t;
+
+// Widest history or index of gshare and tournament, and widest
+// perceptron index, 2^30 entries
+#define MAX_TABLE_BITS 30
+
+// Table layout used unless --layout is given, build with
+// -DDEFAULT_LAYOUT=1 to pack the counter tables by default
+#ifndef DEFAULT_LAYOUT
+#define DEFAULT_LAYOUT 0
+#endif
+
+// A predictor instance, all state lives behind this handle so several
+// predictors can run in one process or on different threads
+typedef struct predictor predictor_t;
+
+// Table entries read by predictor_lookup() for one branch, consumed by
+// predictor_update() so each table is read once per branch
+typedef struct {
+    uint32_t pc;
+    uint8_t prediction;
+    uint32_t gindex;           // global history and selector index
+    uint32_t lindex;           // pht index
+    uint32_t localPattern;     // pht[lindex]
+    uint8_t localPrediction;   // local 2-bit counter
+    uint8_t globalPrediction;  // global 2-bit counter
+    uint8_t choice;            // selector 2-bit counter
+    int8_t *row;               // perceptron row
+    int32_t yout;              // perceptron output
+    tage_lookup_t tage;        // TAGE tables and tags
+} predictor_lookup_t;
+
 //------------------------------------//
 //    Predictor Function Prototypes   //
 //------------------------------------//
 
+// Parse a predictor spec such as "gshare:13" into 'config'
+//
+// Returns True if Successful
+//
+int predictor_parse_config(const char *spec, predictor_config_t *config);
+
+// Write the spec of 'config' to 'buf'
+//
+void predictor_config_name(const predictor_config_t *config, char *buf, size_t len);
+
+// Hardware storage of a predictor, one item per table or register
+#define MAX_STORAGE_ITEMS 8
+typedef struct {
+    const char *name;
+    uint64_t entries;
+    int width;           // bits per entry
+    uint64_t bits;       // entries * width
+} storage_item_t;
+
+typedef struct {
+    int count;
+    storage_item_t items[MAX_STORAGE_ITEMS];
+    uint64_t bits;       // total of all items
+} predictor_storage_t;
+
+// Fill 'storage' with the exact storage of a predictor with 'config'
+//
+void predictor_storage(const predictor_config_t *config, predictor_storage_t *storage);
+
+// Total storage of a predictor with 'config' in bits
+//
+uint64_t predictor_config_bits(const predictor_config_t *config);
+
+// Create a predictor instance for 'config'
+//
+predictor_t *predictor_create(const predictor_config_t *config);
+
+// Configuration actually used by 'p' (custom fixes its own sizes)
+//
+const predictor_config_t *predictor_get_config(const predictor_t *p);
+
+// Fused step: predict the branch at PC 'pc' and fill 'ctx', then train
+// with its outcome. No other call may use 'p' in between.
+//
+uint8_t predictor_lookup(predictor_t *p, uint32_t pc, predictor_lookup_t *ctx);
+void predictor_update(predictor_t *p, const predictor_lookup_t *ctx, uint8_t outcome);
+
+// Per-instance versions of make_prediction and train_predictor, thin
+// wrappers around the fused step
+//
+uint8_t predictor_predict(predictor_t *p, uint32_t pc);
+void predictor_train(predictor_t *p, uint32_t pc, uint8_t outcome);
+
+// Predict and train 'n' branches in order. The predictor type is
+// resolved once for the whole batch. If 'mispredict_out' is not NULL,
+// mispredict_out[i] is set to 1 when branch i was mispredicted.
+//
+// Returns the number of mispredictions
+//
+uint32_t predict_and_train(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+                           size_t n, uint8_t *mispredict_out);
+
+// Shift 'n' branches into the global and local histories of 'p'
+// without reading or training any counter or weight table, the cheap
+// fast-forward of sampled simulation (see sample.h)
+//
+void predictor_skip(predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes, size_t n);
+
+// "specialized" if predict_and_train() runs a kernel built for the
+// configuration of 'p' (see kernels.def), otherwise "generic"
+//
+const char *predictor_kernel_name(const predictor_t *p);
+
+// Print the aliasing and counter state statistics of the tables of
+// 'p' to 'out', recorded only in builds with -DINSTRUMENT
+//
+// Returns False if the build has no instrumentation
+//
+int predictor_report(const predictor_t *p, FILE *out);
+
+// How the table arena of 'p' is backed, one of backingName
+//
+const char *predictor_backing_name(const predictor_t *p);
+
+// Free the instance and all of its tables
+//
+void predictor_destroy(predictor_t *p);
+
 // Initialize the predictor
 //
 void init_predictor();
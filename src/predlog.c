@@ -0,0 +1,327 @@
+//========================================================//
+//  predlog.c                                             //
+//  Source file for the prediction log                    //
+//                                                        //
+//  The simulation formats records into the current      //
+//  buffer with hand-written number formatting. A full   //
+//  buffer is queued for the writer thread and replaced  //
+//  by a free one; the simulation only waits when every  //
+//  buffer is queued.                                     //
+//========================================================//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predlog.h"
+
+#define PREDLOG_BUFFERS       4
+#define PREDLOG_BUFFER_BYTES  (1 << 20)
+
+// Longest record of any format, with a configuration name
+#define PREDLOG_MAX_RECORD    (PREDLOG_NAME_BYTES + 96)
+
+struct predlog {
+    FILE *file;
+    int format;
+    int missesOnly;
+    int configs;
+    char (*names)[PREDLOG_NAME_BYTES];
+
+    char *buffers[PREDLOG_BUFFERS];
+    size_t lengths[PREDLOG_BUFFERS];
+    int current;                // buffer being filled
+    size_t used;                // bytes of the current buffer
+
+    // buffers waiting for the writer, and free buffers
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t freed;
+    int queue[PREDLOG_BUFFERS];
+    int head;
+    int count;
+    int free[PREDLOG_BUFFERS];
+    int numFree;
+    int done;                   // no more buffers will be queued
+    int failed;                 // a write failed
+
+    pthread_t writer;
+};
+
+static const char hexDigits[] = "0123456789abcdef";
+
+//------------------------------------//
+//           Writer Thread            //
+//------------------------------------//
+
+static void *
+write_buffers(void *arg) {
+    predlog_t *log = (predlog_t *) arg;
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (log->count == 0 && !log->done) {
+            pthread_cond_wait(&log->queued, &log->lock);
+        }
+        if (log->count == 0) {
+            break;
+        }
+        int b = log->queue[log->head];
+        log->head = (log->head + 1) % PREDLOG_BUFFERS;
+        log->count--;
+        pthread_mutex_unlock(&log->lock);
+
+        int ok = fwrite(log->buffers[b], 1, log->lengths[b], log->file) == log->lengths[b];
+
+        pthread_mutex_lock(&log->lock);
+        log->failed |= !ok;
+        log->free[log->numFree++] = b;
+        pthread_cond_signal(&log->freed);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// queue the current buffer and continue in a free one
+static void
+submit(predlog_t *log) {
+    pthread_mutex_lock(&log->lock);
+    log->lengths[log->current] = log->used;
+    log->queue[(log->head + log->count) % PREDLOG_BUFFERS] = log->current;
+    log->count++;
+    pthread_cond_signal(&log->queued);
+    while (log->numFree == 0) {
+        pthread_cond_wait(&log->freed, &log->lock);
+    }
+    log->current = log->free[--log->numFree];
+    pthread_mutex_unlock(&log->lock);
+    log->used = 0;
+}
+
+//------------------------------------//
+//             Formatting             //
+//------------------------------------//
+
+static inline char *
+put_string(char *out, const char *s, size_t len) {
+    memcpy(out, s, len);
+    return out + len;
+}
+
+// lower case hex without leading zeros, like %x
+static inline char *
+put_hex(char *out, uint32_t value) {
+    int digits = 1;
+    while (digits < 8 && (value >> (4 * digits)) != 0) {
+        digits++;
+    }
+    for (int d = digits - 1; d >= 0; d--) {
+        *out++ = hexDigits[(value >> (4 * d)) & 0xf];
+    }
+    return out;
+}
+
+static inline char *
+put_decimal(char *out, uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+#define PUT_LITERAL(out, s) put_string(out, s, sizeof(s) - 1)
+
+static char *
+format_text(const predlog_t *log, char *out, int config, uint32_t pc, uint8_t prediction,
+            uint8_t outcome) {
+    if (log->configs > 1) {
+        out = PUT_LITERAL(out, "Config: ");
+        out = put_string(out, log->names[config], strlen(log->names[config]));
+        out = PUT_LITERAL(out, ", ");
+    }
+    out = PUT_LITERAL(out, "PC: 0x");
+    out = put_hex(out, pc);
+    out = PUT_LITERAL(out, ", Prediction: ");
+    *out++ = (char) ('0' + prediction);
+    out = PUT_LITERAL(out, ", Actual Outcome: ");
+    *out++ = (char) ('0' + outcome);
+    *out++ = '\n';
+    return out;
+}
+
+static char *
+format_csv(const predlog_t *log, char *out, int config, uint64_t branch, uint32_t pc,
+           uint8_t prediction, uint8_t outcome) {
+    out = put_decimal(out, branch);
+    *out++ = ',';
+    out = put_string(out, log->names[config], strlen(log->names[config]));
+    out = PUT_LITERAL(out, ",0x");
+    out = put_hex(out, pc);
+    *out++ = ',';
+    *out++ = (char) ('0' + prediction);
+    *out++ = ',';
+    *out++ = (char) ('0' + outcome);
+    *out++ = '\n';
+    return out;
+}
+
+static char *
+format_binary(char *out, int config, uint64_t branch, uint32_t pc, uint8_t prediction,
+              uint8_t outcome) {
+    predlog_record_t record;
+    record.branch = branch;
+    record.pc = pc;
+    record.config = (uint8_t) config;
+    record.prediction = prediction;
+    record.outcome = outcome;
+    record.reserved = 0;
+    memcpy(out, &record, sizeof(record));
+    return out + sizeof(record);
+}
+
+//------------------------------------//
+//           Log Functions            //
+//------------------------------------//
+
+// Parse "text", "csv" or "binary"
+//
+// Returns the format, or -1 if unknown
+//
+int
+predlog_format(const char *name) {
+    if (!strcmp(name, "text")) {
+        return PREDLOG_TEXT;
+    } else if (!strcmp(name, "csv")) {
+        return PREDLOG_CSV;
+    } else if (!strcmp(name, "binary")) {
+        return PREDLOG_BINARY;
+    }
+    return -1;
+}
+
+// Open a log of 'format' at 'path'
+//
+// Returns NULL if the file cannot be opened
+//
+predlog_t *
+predlog_open(const char *path, int format, int missesOnly, char **names, int configs) {
+    FILE *file = strcmp(path, "-") ? fopen(path, (format == PREDLOG_BINARY) ? "wb" : "w") : stdout;
+    if (file == NULL) {
+        return NULL;
+    }
+
+    predlog_t *log = (predlog_t *) calloc(1, sizeof(predlog_t));
+    log->file = file;
+    log->format = format;
+    log->missesOnly = missesOnly;
+    log->configs = configs;
+    log->names = calloc(configs, PREDLOG_NAME_BYTES);
+    for (int c = 0; c < configs; c++) {
+        strncpy(log->names[c], names[c], PREDLOG_NAME_BYTES - 1);
+    }
+
+    for (int b = 0; b < PREDLOG_BUFFERS; b++) {
+        log->buffers[b] = (char *) malloc(PREDLOG_BUFFER_BYTES);
+        if (b > 0) {
+            log->free[log->numFree++] = b;
+        }
+    }
+    log->current = 0;
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->queued, NULL);
+    pthread_cond_init(&log->freed, NULL);
+    pthread_create(&log->writer, NULL, write_buffers, log);
+
+    // the header goes into the first buffer
+    if (format == PREDLOG_BINARY) {
+        predlog_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PREDLOG_MAGIC, PREDLOG_MAGIC_LEN);
+        header.version = PREDLOG_VERSION;
+        header.configs = (uint32_t) configs;
+        memcpy(log->buffers[0], &header, sizeof(header));
+        log->used = sizeof(header);
+        for (int c = 0; c < configs; c++) {
+            if (log->used + PREDLOG_NAME_BYTES > PREDLOG_BUFFER_BYTES) {
+                submit(log);
+            }
+            memcpy(log->buffers[log->current] + log->used, log->names[c], PREDLOG_NAME_BYTES);
+            log->used += PREDLOG_NAME_BYTES;
+        }
+    } else if (format == PREDLOG_CSV) {
+        log->used = sprintf(log->buffers[0], "branch,config,pc,prediction,outcome\n");
+    }
+    return log;
+}
+
+// Log 'n' branches of configuration 'config'
+//
+void
+predlog_batch(predlog_t *log, int config, uint64_t first, const uint32_t *pcs,
+              const uint8_t *outcomes, const uint8_t *misses, size_t n) {
+    char *out = log->buffers[log->current] + log->used;
+    char *end = log->buffers[log->current] + PREDLOG_BUFFER_BYTES - PREDLOG_MAX_RECORD;
+
+    for (size_t i = 0; i < n; i++) {
+        if (log->missesOnly && !misses[i]) {
+            continue;
+        }
+        if (out > end) {
+            log->used = out - log->buffers[log->current];
+            submit(log);
+            out = log->buffers[log->current];
+            end = out + PREDLOG_BUFFER_BYTES - PREDLOG_MAX_RECORD;
+        }
+
+        uint8_t prediction = outcomes[i] ^ misses[i];
+        switch (log->format) {
+            case PREDLOG_TEXT:
+                out = format_text(log, out, config, pcs[i], prediction, outcomes[i]);
+                break;
+            case PREDLOG_CSV:
+                out = format_csv(log, out, config, first + i, pcs[i], prediction, outcomes[i]);
+                break;
+            default:
+                out = format_binary(out, config, first + i, pcs[i], prediction, outcomes[i]);
+                break;
+        }
+    }
+    log->used = out - log->buffers[log->current];
+}
+
+// Write everything still buffered and close the file
+//
+// Returns True if Successful
+//
+int
+predlog_close(predlog_t *log) {
+    pthread_mutex_lock(&log->lock);
+    log->lengths[log->current] = log->used;
+    log->queue[(log->head + log->count) % PREDLOG_BUFFERS] = log->current;
+    log->count++;
+    log->done = 1;
+    pthread_cond_signal(&log->queued);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    int ok = !log->failed && fflush(log->file) == 0;
+    if (log->file != stdout) {
+        ok &= fclose(log->file) == 0;
+    }
+
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->queued);
+    pthread_cond_destroy(&log->freed);
+    for (int b = 0; b < PREDLOG_BUFFERS; b++) {
+        free(log->buffers[b]);
+    }
+    free(log->names);
+    free(log);
+    return ok;
+}
@@ -0,0 +1,81 @@
+//========================================================//
+//  predlog.h                                             //
+//  Header file for the prediction log                    //
+//                                                        //
+//  Records of every prediction (or only of the           //
+//  mispredictions) are formatted into large buffers      //
+//  that a writer thread hands to the file, so the        //
+//  simulation never waits on printf or on the disk.      //
+//========================================================//
+
+#ifndef PREDLOG_H
+#define PREDLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//------------------------------------//
+//         Log Format Defines         //
+//------------------------------------//
+#define PREDLOG_TEXT    0   // the --verbose lines
+#define PREDLOG_CSV     1   // "branch,config,pc,prediction,outcome"
+#define PREDLOG_BINARY  2   // see below
+
+// Binary log layout (little endian):
+//   header:  predlog_header_t, then 'configs' names of
+//            PREDLOG_NAME_BYTES, zero padded
+//   records: predlog_record_t, in the order of the simulation
+#define PREDLOG_MAGIC       "\x89" "BPLOG\r\n"
+#define PREDLOG_MAGIC_LEN   8
+#define PREDLOG_VERSION     1
+#define PREDLOG_NAME_BYTES  64
+
+typedef struct {
+    char magic[PREDLOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t configs;    // number of predictor configurations
+} predlog_header_t;
+
+typedef struct {
+    uint64_t branch;     // index of the branch in the trace
+    uint32_t pc;
+    uint8_t config;      // index of the configuration
+    uint8_t prediction;
+    uint8_t outcome;
+    uint8_t reserved;    // 0
+} predlog_record_t;
+
+typedef struct predlog predlog_t;
+
+//------------------------------------//
+//      Log Function Prototypes       //
+//------------------------------------//
+
+// Parse "text", "csv" or "binary"
+//
+// Returns the format, or -1 if unknown
+//
+int predlog_format(const char *name);
+
+// Open a log of 'format' at 'path' ("-" for stdout) for 'configs'
+// configurations named 'names'. With 'missesOnly' only mispredictions
+// are logged. The text format names the configuration on every line
+// only if there are several.
+//
+// Returns NULL if the file cannot be opened
+//
+predlog_t *predlog_open(const char *path, int format, int missesOnly, char **names, int configs);
+
+// Log 'n' branches of configuration 'config' starting at branch
+// 'first' of the trace, misses[i] is 1 when branch i was mispredicted
+//
+void predlog_batch(predlog_t *log, int config, uint64_t first, const uint32_t *pcs,
+                   const uint8_t *outcomes, const uint8_t *misses, size_t n);
+
+// Write everything still buffered, stop the writer and close the file
+//
+// Returns True if Successful
+//
+int predlog_close(predlog_t *log);
+
+#endif
@@ -0,0 +1,229 @@
+//========================================================//
+//  profile.c                                             //
+//  Source file for the per-PC misprediction profiler     //
+//                                                        //
+//  The counters are a flat array indexed by branch ID.   //
+//  Branches given by PC find their ID by linear probing  //
+//  in a power of two table that doubles at half load;    //
+//  with the dense IDs of the trace reader a branch is    //
+//  one array update and the table is only touched the    //
+//  first time an ID is seen.                             //
+//========================================================//
+
+#include <stdlib.h>
+#include "profile.h"
+
+#define PROFILE_INITIAL_BITS 12
+
+struct profile {
+    profile_entry_t *entries;   // indexed by branch ID
+    uint32_t capacity;
+    uint32_t ids;               // IDs given out by profile_batch()
+
+    uint32_t *slots;            // ID + 1 of a PC, 0 is empty
+    int bits;                   // the table has 2^bits slots
+    uint32_t mask;
+    uint32_t size;              // entries in use
+    uint64_t mispredictions;    // total, for the share of each branch
+};
+
+static inline uint32_t
+slot_of(uint32_t pc, int bits) {
+    return (pc * 0x9e3779b1u) >> (32 - bits);
+}
+
+static void
+alloc_slots(profile_t *profile, int bits) {
+    profile->bits = bits;
+    profile->mask = (1u << bits) - 1;
+    profile->slots = (uint32_t *) calloc((size_t) 1 << bits, sizeof(uint32_t));
+}
+
+profile_t *
+profile_create(void) {
+    profile_t *profile = (profile_t *) calloc(1, sizeof(profile_t));
+    alloc_slots(profile, PROFILE_INITIAL_BITS);
+    return profile;
+}
+
+// make room for entry 'id'
+static void
+reserve(profile_t *profile, uint32_t id) {
+    uint32_t capacity = (profile->capacity == 0) ? 1024 : profile->capacity;
+    while (capacity <= id) {
+        capacity *= 2;
+    }
+    profile->entries = (profile_entry_t *) realloc(profile->entries, capacity * sizeof(profile_entry_t));
+    for (uint32_t k = profile->capacity; k < capacity; k++) {
+        profile->entries[k].executions = 0;
+    }
+    profile->capacity = capacity;
+}
+
+// add 'pc' with entry 'id' to the table, doubling it at half load
+static void
+add_pc(profile_t *profile, uint32_t pc, uint32_t id) {
+    if (2 * (profile->size + 1) > profile->mask + 1) {
+        uint32_t *old = profile->slots;
+        uint32_t oldSize = profile->mask + 1;
+        alloc_slots(profile, profile->bits + 1);
+        for (uint32_t k = 0; k < oldSize; k++) {
+            if (old[k] != 0) {
+                uint32_t slot = slot_of(profile->entries[old[k] - 1].pc, profile->bits);
+                while (profile->slots[slot] != 0) {
+                    slot = (slot + 1) & profile->mask;
+                }
+                profile->slots[slot] = old[k];
+            }
+        }
+        free(old);
+    }
+
+    uint32_t slot = slot_of(pc, profile->bits);
+    while (profile->slots[slot] != 0) {
+        slot = (slot + 1) & profile->mask;
+    }
+    profile->slots[slot] = id + 1;
+    profile->size++;
+}
+
+// ID of 'pc', or UINT32_MAX if it was never seen
+static inline uint32_t
+find_id(const profile_t *profile, uint32_t pc) {
+    uint32_t slot = slot_of(pc, profile->bits);
+    for (uint32_t id; (id = profile->slots[slot]) != 0; slot = (slot + 1) & profile->mask) {
+        if (profile->entries[id - 1].pc == pc) {
+            return id - 1;
+        }
+    }
+    return UINT32_MAX;
+}
+
+// entry 'id' of the branch at 'pc', a new one if it is empty
+static inline profile_entry_t *
+entry_of(profile_t *profile, uint32_t id, uint32_t pc) {
+    if (id >= profile->capacity) {
+        reserve(profile, id);
+    }
+    profile_entry_t *e = &profile->entries[id];
+    if (e->executions == 0) {
+        e->pc = pc;
+        e->mispredictions = 0;
+        e->taken = 0;
+        add_pc(profile, pc, id);
+    }
+    return e;
+}
+
+// Count 'n' branches, IDs are given in order of first appearance
+//
+void
+profile_batch(profile_t *profile, const uint32_t *pcs, const uint8_t *outcomes,
+              const uint8_t *misses, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t id = find_id(profile, pcs[i]);
+        profile_entry_t *e = entry_of(profile, (id != UINT32_MAX) ? id : profile->ids++, pcs[i]);
+        e->executions++;
+        e->mispredictions += misses[i];
+        e->taken += outcomes[i];
+        profile->mispredictions += misses[i];
+    }
+}
+
+// Count 'n' branches with their dense IDs, flat array updates only
+//
+void
+profile_batch_ids(profile_t *profile, const uint32_t *ids, const uint32_t *pcs, const uint8_t *outcomes,
+                  const uint8_t *misses, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        profile_entry_t *e = entry_of(profile, ids[i], pcs[i]);
+        e->executions++;
+        e->mispredictions += misses[i];
+        e->taken += outcomes[i];
+        profile->mispredictions += misses[i];
+    }
+}
+
+// Counters of the branch at 'pc', or NULL if it was never seen
+//
+const profile_entry_t *
+profile_find(const profile_t *profile, uint32_t pc) {
+    uint32_t id = find_id(profile, pc);
+    return (id != UINT32_MAX) ? &profile->entries[id] : NULL;
+}
+
+uint32_t
+profile_size(const profile_t *profile) {
+    return profile->size;
+}
+
+// most mispredictions first, then most executions, then lowest pc
+static int
+compare_entries(const void *a, const void *b) {
+    const profile_entry_t *x = (const profile_entry_t *) a;
+    const profile_entry_t *y = (const profile_entry_t *) b;
+    if (x->mispredictions != y->mispredictions) {
+        return (x->mispredictions > y->mispredictions) ? -1 : 1;
+    }
+    if (x->executions != y->executions) {
+        return (x->executions > y->executions) ? -1 : 1;
+    }
+    return (x->pc < y->pc) ? -1 : (x->pc > y->pc);
+}
+
+// every entry in use, sorted by compare_entries
+static profile_entry_t *
+sorted_entries(const profile_t *profile) {
+    profile_entry_t *list = (profile_entry_t *) malloc((profile->size + 1) * sizeof(profile_entry_t));
+    uint32_t n = 0;
+    for (uint32_t k = 0; k < profile->capacity; k++) {
+        if (profile->entries[k].executions != 0) {
+            list[n++] = profile->entries[k];
+        }
+    }
+    qsort(list, n, sizeof(profile_entry_t), compare_entries);
+    return list;
+}
+
+// Print the 'top' branches with the most mispredictions
+//
+void
+profile_print_top(const profile_t *profile, FILE *out, int top) {
+    profile_entry_t *list = sorted_entries(profile);
+    if ((uint32_t) top > profile->size) {
+        top = (int) profile->size;
+    }
+
+    fprintf(out, "%-12s %12s %12s %10s %10s %10s\n", "PC", "Executions", "Incorrect",
+            "Mispredict", "Taken", "Share");
+    for (int k = 0; k < top; k++) {
+        const profile_entry_t *e = &list[k];
+        double share = (profile->mispredictions > 0) ? 100.0 * e->mispredictions / profile->mispredictions : 0;
+        fprintf(out, "0x%-10x %12llu %12llu %9.3f%% %9.3f%% %9.3f%%\n", e->pc,
+                (unsigned long long) e->executions, (unsigned long long) e->mispredictions, 100.0 * e->mispredictions / e->executions,
+                100.0 * e->taken / e->executions, share);
+    }
+    free(list);
+}
+
+// Write every branch as one CSV row
+//
+void
+profile_write_csv(const profile_t *profile, FILE *out, const char *config) {
+    profile_entry_t *list = sorted_entries(profile);
+    for (uint32_t k = 0; k < profile->size; k++) {
+        if (config != NULL) {
+            fprintf(out, "%s,", config);
+        }
+        fprintf(out, "0x%x,%llu,%llu,%llu\n", list[k].pc, (unsigned long long) list[k].executions,
+                (unsigned long long) list[k].mispredictions, (unsigned long long) list[k].taken);
+    }
+    free(list);
+}
+
+void
+profile_destroy(profile_t *profile) {
+    free(profile->entries);
+    free(profile->slots);
+    free(profile);
+}
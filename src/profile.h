@@ -0,0 +1,60 @@
+//========================================================//
+//  profile.h                                             //
+//  Header file for the per-PC misprediction profiler     //
+//                                                        //
+//  Counts executions, mispredictions and taken outcomes  //
+//  of every static branch in a flat array indexed by     //
+//  dense branch ID, and reports the branches that cost   //
+//  the most mispredictions.                              //
+//========================================================//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Counters of one static branch, an entry with no executions is empty
+typedef struct {
+    uint32_t pc;
+    uint64_t executions;
+    uint64_t mispredictions;
+    uint64_t taken;
+} profile_entry_t;
+
+typedef struct profile profile_t;
+
+profile_t *profile_create(void);
+
+// Count 'n' branches, misses[i] is 1 when branch i was mispredicted
+//
+void profile_batch(profile_t *profile, const uint32_t *pcs, const uint8_t *outcomes,
+                   const uint8_t *misses, size_t n);
+
+// Count 'n' branches with their dense IDs from trace_read_ids(). A
+// profile is filled either by IDs or by PCs, not both.
+//
+void profile_batch_ids(profile_t *profile, const uint32_t *ids, const uint32_t *pcs, const uint8_t *outcomes,
+                       const uint8_t *misses, size_t n);
+
+// Counters of the branch at 'pc', or NULL if it was never seen
+//
+const profile_entry_t *profile_find(const profile_t *profile, uint32_t pc);
+
+// Number of distinct branches seen
+//
+uint32_t profile_size(const profile_t *profile);
+
+// Print the 'top' branches with the most mispredictions as a table
+//
+void profile_print_top(const profile_t *profile, FILE *out, int top);
+
+// Write every branch as one CSV row, most mispredictions first. The
+// 'config' column is written before the others if it is not NULL.
+//
+void profile_write_csv(const profile_t *profile, FILE *out, const char *config);
+
+void profile_destroy(profile_t *profile);
+
+#endif
@@ -0,0 +1,183 @@
+//========================================================//
+//  sample.c                                              //
+//  Source file for sampled simulation                    //
+//                                                        //
+//  Stratified sampling: one interval at a random place  //
+//  in every period, so loops in the trace cannot line up //
+//  with the schedule. The cold start of the tables is    //
+//  not spread evenly, so the first period is measured in //
+//  full and only the rest is estimated. The intervals    //
+//  are equally long, the estimate of the rest is the     //
+//  mean of their rates and its error comes from their    //
+//  sample variance with a Student t quantile, corrected  //
+//  for the fraction of the rest that was measured.       //
+//========================================================//
+
+#include <math.h>
+#include <stdio.h>
+#include "sample.h"
+
+// Parse "<period>:<interval>[:<warmup>]" into 'config'
+//
+// Returns True if Successful
+//
+int
+sample_parse(const char *spec, sample_config_t *config) {
+    unsigned period = 0, interval = 0, warmup = 0;
+    int fields = sscanf(spec, "%u:%u:%u", &period, &interval, &warmup);
+    if (fields < 2 || interval == 0 || (uint64_t) interval + warmup > period) {
+        return 0;
+    }
+
+    config->period = period;
+    config->interval = interval;
+    config->warmup = warmup;
+    config->functional = (fields == 2);
+    return 1;
+}
+
+void
+sample_init(sampler_t *s, const sample_config_t *config) {
+    s->config = *config;
+    if (s->config.functional) {
+        s->config.warmup = 0;
+    }
+    s->position = 0;
+    s->intervalMisses = 0;
+    s->measured = 0;
+    s->mispredictions = 0;
+    s->firstMisses = 0;
+    s->intervals = 0;
+    s->sumSquares = 0;
+    s->seed = 1;
+}
+
+// Draw where the interval of the next period starts, anywhere after
+// its warm-up
+static void
+next_period(sampler_t *s) {
+    uint32_t slots = s->config.period - s->config.interval - s->config.warmup + 1;
+    s->seed = s->seed * 1103515245 + 12345;
+    s->measureStart = s->config.warmup + (uint32_t) (((uint64_t) (s->seed >> 8) * slots) >> 24);
+}
+
+// Feed the next 'n' branches of the trace to 'p' on the schedule of 's'
+//
+void
+sample_batch(sampler_t *s, predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+             size_t n) {
+    const uint32_t period = s->config.period;
+
+    size_t i = 0;
+
+    // measure the whole first period
+    if (s->position < period) {
+        size_t count = period - s->position;
+        count = (count < n) ? count : n;
+        uint32_t missed = predict_and_train(p, pcs, outcomes, count, NULL);
+        s->firstMisses += missed;
+        s->mispredictions += missed;
+        s->measured += count;
+        s->position += count;
+        i = count;
+    }
+
+    while (i < n) {
+        // offset in the current period and the end of its phase
+        uint32_t offset = (uint32_t) (s->position % period);
+        if (offset == 0) {
+            next_period(s);
+        }
+        uint32_t measureStart = s->measureStart;
+        uint32_t measureEnd = measureStart + s->config.interval;
+        uint32_t warmStart = measureStart - s->config.warmup;
+        uint32_t phaseEnd = (offset < warmStart) ? warmStart
+                          : (offset < measureStart) ? measureStart
+                          : (offset < measureEnd) ? measureEnd : period;
+        size_t count = phaseEnd - offset;
+        if (count > n - i) {
+            count = n - i;
+        }
+
+        if (offset >= measureStart && offset < measureEnd) {
+            s->intervalMisses += predict_and_train(p, pcs + i, outcomes + i, count, NULL);
+            if (offset + count == measureEnd) {
+                double rate = 100.0 * s->intervalMisses / s->config.interval;
+                s->measured += s->config.interval;
+                s->mispredictions += s->intervalMisses;
+                s->sumSquares += rate * rate;
+                s->intervals++;
+                s->intervalMisses = 0;
+            }
+        } else if ((offset >= warmStart && offset < measureStart) || s->config.functional) {
+            // train, but do not count
+            predict_and_train(p, pcs + i, outcomes + i, count, NULL);
+        } else {
+            predictor_skip(p, pcs + i, outcomes + i, count);
+        }
+
+        s->position += count;
+        i += count;
+    }
+}
+
+// Two sided 95% quantile of the Student t distribution with 'df'
+// degrees of freedom, from a table up to 30 and from its expansion
+// around the normal quantile above
+static double
+t_quantile(uint32_t df) {
+    static const double table[31] = {
+        INFINITY, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    if (df <= 30) {
+        return table[df];
+    }
+    double z = SAMPLE_Z;
+    return z + (z * z * z + z) / (4.0 * df) + (5 * pow(z, 5) + 16 * z * z * z + 3 * z) / (96.0 * df * df);
+}
+
+// Estimated misprediction rate and the half width of its 95%
+// confidence interval, in percent
+//
+void
+sample_estimate(const sampler_t *s, double *rate, double *halfWidth) {
+    uint64_t first = (s->position < s->config.period) ? s->position : s->config.period;
+    if (s->position == 0) {
+        *rate = NAN;
+        *halfWidth = INFINITY;
+        return;
+    }
+    if (s->position == first) {
+        *rate = 100.0 * s->firstMisses / first;
+        *halfWidth = 0;
+        return;
+    }
+
+    uint32_t k = s->intervals;
+    if (k < 2) {
+        *rate = 100.0 * s->mispredictions / s->measured;
+        *halfWidth = INFINITY;
+        return;
+    }
+
+    // the first period counts as measured, the rest at the mean
+    // interval rate
+    uint64_t sampled = (uint64_t) k * s->config.interval;
+    uint64_t rest = s->position - first;
+    double restRate = 100.0 * (s->mispredictions - s->firstMisses) / sampled;
+    *rate = (100.0 * s->firstMisses + restRate * rest) / s->position;
+
+    double variance = (s->sumSquares - k * restRate * restRate) / (k - 1);
+    if (variance < 0) {
+        variance = 0;
+    }
+
+    // nothing is left to estimate when every branch was measured
+    double unmeasured = 1.0 - (double) sampled / rest;
+    if (unmeasured < 0) {
+        unmeasured = 0;
+    }
+    *halfWidth = t_quantile(k - 1) * sqrt(variance / k * unmeasured) * rest / s->position;
+}
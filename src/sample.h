@@ -0,0 +1,72 @@
+//========================================================//
+//  sample.h                                              //
+//  Header file for sampled simulation                    //
+//                                                        //
+//  The trace is cut into periods of P branches. The      //
+//  first period is measured in full, then U branches at  //
+//  a random place in each period. The rest is fast-      //
+//  forwarded with the tables warm, and the misprediction //
+//  rate is estimated from the measured branches with a   //
+//  95% confidence interval.                              //
+//========================================================//
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "predictor.h"
+
+// Normal quantile of the two sided 95% confidence interval, the
+// Student t quantile is used with fewer intervals
+#define SAMPLE_Z 1.96
+
+// Sampling schedule, every period of 'period' branches after the first
+// holds 'interval' measured branches right after 'warmup' that train
+// the tables
+typedef struct {
+    uint32_t period;        // P
+    uint32_t interval;      // U
+    uint32_t warmup;        // W, only without functional warming
+    int functional;         // train the tables on every branch that is
+                            // not measured, otherwise only the warm-up
+                            // does and the rest just shifts the histories
+} sample_config_t;
+
+// Sampling state and results of one predictor
+typedef struct {
+    sample_config_t config;
+    uint64_t position;          // branches seen
+    uint32_t intervalMisses;    // mispredictions in the current interval
+    uint64_t measured;          // branches in the first period and in
+                                // complete intervals
+    uint64_t mispredictions;    // mispredictions in the measured branches
+    uint64_t firstMisses;       // mispredictions in the first period
+    uint32_t intervals;         // complete intervals
+    double sumSquares;          // of the interval misprediction rates
+    uint32_t measureStart;      // offset of the interval in this period
+    uint32_t seed;              // interval placement, deterministic
+} sampler_t;
+
+// Parse "<period>:<interval>[:<warmup>]" into 'config', functional
+// warming unless the warm-up is given
+//
+// Returns True if Successful
+//
+int sample_parse(const char *spec, sample_config_t *config);
+
+void sample_init(sampler_t *s, const sample_config_t *config);
+
+// Feed the next 'n' branches of the trace to 'p' on the schedule of 's'
+//
+void sample_batch(sampler_t *s, predictor_t *p, const uint32_t *pcs, const uint8_t *outcomes,
+                  size_t n);
+
+// Estimated misprediction rate of the whole trace and the half width
+// of its 95% confidence interval, both in percent. The half width is
+// zero when the trace fits in the first period and infinite with
+// fewer than two intervals after it.
+//
+void sample_estimate(const sampler_t *s, double *rate, double *halfWidth);
+
+#endif
@@ -0,0 +1,376 @@
+//========================================================//
+//  seekable.c                                            //
+//  Source file for the seekable compressed traces        //
+//                                                        //
+//  The file is mapped and the index copied out of it.    //
+//  Workers claim frames in order and decode each with    //
+//  zlib into its slot of a bounded ring, the consumer    //
+//  takes them back in order like pbzip does. A seek      //
+//  waits for the running frames and restarts the ring.   //
+//========================================================//
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "seekable.h"
+#include "trace.h"
+
+// Slot states
+#define SLOT_RUNNING 0  // being decoded
+#define SLOT_DONE    1  // decoded, waiting for the consumer
+#define SLOT_FAILED  2  // frame did not decode
+
+typedef struct {
+    int state;
+    uint8_t *out;       // decompressed frame
+    size_t outLen;
+    size_t outCap;
+} slot_t;
+
+struct seekable {
+    const uint8_t *data;   // mapped file
+    size_t len;
+    seekable_header_t header;
+    seekable_frame_t *index;
+
+    int threads;
+    pthread_t *workers;
+
+    slot_t *ring;
+    uint64_t ringSize;
+    uint64_t head;         // next frame handed to the consumer
+    uint64_t claim;        // next frame decoded by a worker
+    int running;           // frames being decoded
+    int held;              // consumer still holds ring[head]
+    int seeking;           // workers must not claim frames
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+struct seekable_writer {
+    FILE *file;
+    seekable_header_t header;
+    int failed;
+
+    // frame being filled
+    uint8_t *frame;
+    uint32_t blocks;
+    uint32_t branches;
+
+    uint8_t *packed;       // compressed frame
+    uLong packedCap;
+
+    seekable_frame_t *index;
+    uint64_t indexCap;
+};
+
+// Fold 'blocks' binary trace blocks into the checksum
+static uint64_t
+checksum_blocks(const uint8_t *data, uint32_t blocks) {
+    uint64_t sum = TRACE_CHECKSUM_SEED;
+    const uint8_t *end = data + (size_t) blocks * TRACE_BLOCK_BYTES;
+    for (; data < end; data += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        sum = trace_checksum(sum, word);
+    }
+    return sum;
+}
+
+//------------------------------------//
+//              Threads               //
+//------------------------------------//
+
+// Decode frame 'f' into 'slot', returns True if Successful
+static int
+decode_frame(const seekable_t *sk, uint64_t f, slot_t *slot) {
+    const seekable_frame_t *frame = &sk->index[f];
+    size_t need = (size_t) frame->blocks * TRACE_BLOCK_BYTES;
+    if (need > slot->outCap) {
+        slot->outCap = need;
+        slot->out = (uint8_t *) realloc(slot->out, need);
+    }
+
+    uLongf outLen = need;
+    int ret = uncompress(slot->out, &outLen, sk->data + frame->offset, frame->bytes);
+    slot->outLen = outLen;
+    return ret == Z_OK && outLen == need && checksum_blocks(slot->out, frame->blocks) == frame->checksum;
+}
+
+static void *
+decode_frames(void *arg) {
+    seekable_t *sk = (seekable_t *) arg;
+
+    pthread_mutex_lock(&sk->lock);
+    for (;;) {
+        while (!sk->stop && (sk->seeking || sk->claim == sk->header.frames ||
+                             sk->claim - sk->head >= sk->ringSize)) {
+            pthread_cond_wait(&sk->changed, &sk->lock);
+        }
+        if (sk->stop) {
+            break;
+        }
+
+        uint64_t f = sk->claim++;
+        slot_t *slot = &sk->ring[f % sk->ringSize];
+        slot->state = SLOT_RUNNING;
+        sk->running++;
+        pthread_mutex_unlock(&sk->lock);
+
+        int ok = decode_frame(sk, f, slot);
+
+        pthread_mutex_lock(&sk->lock);
+        slot->state = ok ? SLOT_DONE : SLOT_FAILED;
+        sk->running--;
+        pthread_cond_broadcast(&sk->changed);
+    }
+    pthread_mutex_unlock(&sk->lock);
+    return NULL;
+}
+
+//------------------------------------//
+//         Reader Functions           //
+//------------------------------------//
+
+// Check the header and that every frame lies before the index
+static int
+valid_index(const seekable_t *sk) {
+    const seekable_header_t *h = &sk->header;
+    if (memcmp(h->magic, SEEKABLE_MAGIC, SEEKABLE_MAGIC_LEN) != 0 || h->version != SEEKABLE_VERSION ||
+        h->frameBranches == 0 || h->frameBranches % TRACE_BLOCK_BRANCHES != 0 ||
+        h->frames != (h->count + h->frameBranches - 1) / h->frameBranches ||
+        h->indexOffset > sk->len || (sk->len - h->indexOffset) / sizeof(seekable_frame_t) < h->frames) {
+        return 0;
+    }
+
+    for (uint64_t f = 0; f < h->frames; f++) {
+        const seekable_frame_t *frame = &sk->index[f];
+        uint64_t branches = h->count - f * h->frameBranches;
+        branches = (branches < h->frameBranches) ? branches : h->frameBranches;
+        if (frame->offset < sizeof(seekable_header_t) || frame->offset > h->indexOffset ||
+            frame->bytes > h->indexOffset - frame->offset ||
+            frame->blocks != (branches + TRACE_BLOCK_BRANCHES - 1) / TRACE_BLOCK_BRANCHES) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+seekable_t *
+seekable_open(FILE *stream, int threads) {
+    struct stat st;
+    int fd = fileno(stream);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(seekable_header_t)) {
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    seekable_t *sk = (seekable_t *) calloc(1, sizeof(seekable_t));
+    sk->data = (const uint8_t *) map;
+    sk->len = st.st_size;
+    memcpy(&sk->header, sk->data, sizeof(seekable_header_t));
+    if (sk->header.indexOffset <= sk->len &&
+        (sk->len - sk->header.indexOffset) / sizeof(seekable_frame_t) >= sk->header.frames) {
+        sk->index = (seekable_frame_t *) malloc(sk->header.frames * sizeof(seekable_frame_t) + 1);
+        memcpy(sk->index, sk->data + sk->header.indexOffset, sk->header.frames * sizeof(seekable_frame_t));
+    }
+    if (sk->index == NULL || !valid_index(sk)) {
+        seekable_close(sk);
+        return NULL;
+    }
+
+    sk->threads = (threads < 1) ? 1 : threads;
+    sk->ringSize = 2 * sk->threads + 2;
+    sk->ring = (slot_t *) calloc(sk->ringSize, sizeof(slot_t));
+    sk->workers = (pthread_t *) malloc(sk->threads * sizeof(pthread_t));
+    pthread_mutex_init(&sk->lock, NULL);
+    pthread_cond_init(&sk->changed, NULL);
+    for (int i = 0; i < sk->threads; i++) {
+        pthread_create(&sk->workers[i], NULL, decode_frames, sk);
+    }
+    return sk;
+}
+
+uint64_t
+seekable_count(const seekable_t *sk) {
+    return sk->header.count;
+}
+
+uint64_t
+seekable_seek(seekable_t *sk, uint64_t branch) {
+    uint64_t f = branch / sk->header.frameBranches;
+    f = (f < sk->header.frames) ? f : sk->header.frames;
+
+    pthread_mutex_lock(&sk->lock);
+    sk->seeking = 1;
+    while (sk->running > 0) {
+        pthread_cond_wait(&sk->changed, &sk->lock);
+    }
+    sk->head = sk->claim = f;
+    sk->held = 0;
+    sk->seeking = 0;
+    pthread_cond_broadcast(&sk->changed);
+    pthread_mutex_unlock(&sk->lock);
+
+    return f * sk->header.frameBranches;
+}
+
+int
+seekable_next(seekable_t *sk, const uint8_t **data, size_t *len) {
+    pthread_mutex_lock(&sk->lock);
+
+    // release the frame returned by the previous call
+    if (sk->held) {
+        sk->held = 0;
+        sk->head++;
+        pthread_cond_broadcast(&sk->changed);
+    }
+
+    for (;;) {
+        if (sk->head == sk->header.frames) {
+            pthread_mutex_unlock(&sk->lock);
+            return 0;
+        }
+        if (sk->head < sk->claim) {
+            int state = sk->ring[sk->head % sk->ringSize].state;
+            if (state == SLOT_DONE || state == SLOT_FAILED) {
+                break;
+            }
+        }
+        pthread_cond_wait(&sk->changed, &sk->lock);
+    }
+
+    slot_t *slot = &sk->ring[sk->head % sk->ringSize];
+    sk->held = 1;
+    pthread_mutex_unlock(&sk->lock);
+
+    if (slot->state == SLOT_FAILED) {
+        return -1;
+    }
+    *data = slot->out;
+    *len = slot->outLen;
+    return 1;
+}
+
+void
+seekable_close(seekable_t *sk) {
+    if (sk->threads > 0) {
+        pthread_mutex_lock(&sk->lock);
+        sk->stop = 1;
+        pthread_cond_broadcast(&sk->changed);
+        pthread_mutex_unlock(&sk->lock);
+
+        for (int i = 0; i < sk->threads; i++) {
+            pthread_join(sk->workers[i], NULL);
+        }
+        for (uint64_t i = 0; i < sk->ringSize; i++) {
+            free(sk->ring[i].out);
+        }
+        pthread_mutex_destroy(&sk->lock);
+        pthread_cond_destroy(&sk->changed);
+        free(sk->ring);
+        free(sk->workers);
+    }
+
+    munmap((void *) sk->data, sk->len);
+    free(sk->index);
+    free(sk);
+}
+
+//------------------------------------//
+//         Writer Functions           //
+//------------------------------------//
+
+seekable_writer_t *
+seekable_create(const char *path, uint32_t frameBranches) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    seekable_writer_t *w = (seekable_writer_t *) calloc(1, sizeof(seekable_writer_t));
+    w->file = file;
+    memcpy(w->header.magic, SEEKABLE_MAGIC, SEEKABLE_MAGIC_LEN);
+    w->header.version = SEEKABLE_VERSION;
+    w->header.frameBranches = frameBranches;
+    w->header.indexOffset = sizeof(seekable_header_t);
+
+    size_t frameBytes = (size_t) (frameBranches / TRACE_BLOCK_BRANCHES) * TRACE_BLOCK_BYTES;
+    w->frame = (uint8_t *) malloc(frameBytes);
+    w->packedCap = compressBound(frameBytes);
+    w->packed = (uint8_t *) malloc(w->packedCap);
+
+    // the header is rewritten once the index is written
+    w->failed = fwrite(&w->header, sizeof(w->header), 1, file) != 1;
+    return w;
+}
+
+// Compress the frame being filled and add it to the index
+static void
+write_frame(seekable_writer_t *w) {
+    uLongf packedLen = w->packedCap;
+    if (compress2(w->packed, &packedLen, w->frame, (uLong) w->blocks * TRACE_BLOCK_BYTES,
+                  Z_DEFAULT_COMPRESSION) != Z_OK ||
+        fwrite(w->packed, 1, packedLen, w->file) != packedLen) {
+        w->failed = 1;
+    }
+
+    if (w->header.frames == w->indexCap) {
+        w->indexCap = (w->indexCap == 0) ? 64 : 2 * w->indexCap;
+        w->index = (seekable_frame_t *) realloc(w->index, w->indexCap * sizeof(seekable_frame_t));
+    }
+    seekable_frame_t *frame = &w->index[w->header.frames++];
+    frame->offset = w->header.indexOffset;
+    frame->bytes = (uint32_t) packedLen;
+    frame->blocks = w->blocks;
+    frame->checksum = checksum_blocks(w->frame, w->blocks);
+
+    w->header.indexOffset += packedLen;
+    w->blocks = 0;
+    w->branches = 0;
+}
+
+int
+seekable_add(seekable_writer_t *w, const uint8_t *block, uint32_t branches) {
+    memcpy(w->frame + (size_t) w->blocks * TRACE_BLOCK_BYTES, block, TRACE_BLOCK_BYTES);
+    w->blocks++;
+    w->branches += branches;
+    w->header.count += branches;
+    if (w->branches == w->header.frameBranches) {
+        write_frame(w);
+    }
+    return !w->failed;
+}
+
+int
+seekable_finish(seekable_writer_t *w) {
+    if (w->blocks > 0) {
+        write_frame(w);
+    }
+    if (w->header.frames > 0 &&
+        fwrite(w->index, sizeof(seekable_frame_t), w->header.frames, w->file) != w->header.frames) {
+        w->failed = 1;
+    }
+    rewind(w->file);
+    if (fwrite(&w->header, sizeof(w->header), 1, w->file) != 1) {
+        w->failed = 1;
+    }
+
+    int ok = !w->failed;
+    ok &= fclose(w->file) == 0;
+    free(w->frame);
+    free(w->packed);
+    free(w->index);
+    free(w);
+    return ok;
+}
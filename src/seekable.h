@@ -0,0 +1,106 @@
+//========================================================//
+//  seekable.h                                            //
+//  Header file for the seekable compressed traces        //
+//                                                        //
+//  The blocks of a binary trace are grouped into frames  //
+//  of a fixed number of branches, each compressed on     //
+//  its own with zlib, and an index of the frames is      //
+//  written at the end. A reader can start at any branch  //
+//  by decoding only the frame that holds it, and frames  //
+//  are decoded ahead on a pool of worker threads.        //
+//========================================================//
+
+#ifndef SEEKABLE_H
+#define SEEKABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Seekable trace layout (little endian):
+//   header:  seekable_header_t, 40 bytes
+//   frames:  'frames' zlib streams, frame f decompresses to the binary
+//            trace blocks (see trace.h) of branches
+//            [f * frameBranches, (f + 1) * frameBranches)
+//   index:   'frames' seekable_frame_t at 'indexOffset'
+#define SEEKABLE_MAGIC       "\x89" "BPSEEK\n"
+#define SEEKABLE_MAGIC_LEN   8
+#define SEEKABLE_VERSION     1
+#define SEEKABLE_FRAME_BRANCHES (1 << 16)
+
+typedef struct {
+    char magic[SEEKABLE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t frameBranches;   // a multiple of TRACE_BLOCK_BRANCHES
+    uint64_t count;           // number of branches
+    uint64_t frames;
+    uint64_t indexOffset;     // file offset of the frame index
+} seekable_header_t;
+
+typedef struct {
+    uint64_t offset;          // file offset of the compressed frame
+    uint32_t bytes;           // compressed size
+    uint32_t blocks;          // binary trace blocks in the frame
+    uint64_t checksum;        // trace_checksum() of the blocks, from the seed
+} seekable_frame_t;
+
+typedef struct seekable seekable_t;
+typedef struct seekable_writer seekable_writer_t;
+
+//------------------------------------//
+//             Reading                //
+//------------------------------------//
+
+// Read the header and index of the regular file 'stream' and start
+// decoding frames from the first one on 'threads' workers
+//
+// Returns NULL if the file is not a valid seekable trace
+//
+seekable_t *seekable_open(FILE *stream, int threads);
+
+// Number of branches in the trace
+//
+uint64_t seekable_count(const seekable_t *sk);
+
+// Restart decoding at the frame holding 'branch'
+//
+// Returns the first branch of that frame
+//
+uint64_t seekable_seek(seekable_t *sk, uint64_t branch);
+
+// Get the next decompressed frame, its blocks stay valid until the
+// next call
+//
+// Returns 1 if a frame was returned, 0 at the end, -1 on a corrupt frame
+//
+int seekable_next(seekable_t *sk, const uint8_t **data, size_t *len);
+
+// Stop the workers and release all buffers
+//
+void seekable_close(seekable_t *sk);
+
+//------------------------------------//
+//             Writing                //
+//------------------------------------//
+
+// Create a seekable trace at 'path' with 'frameBranches' branches per
+// frame, a multiple of TRACE_BLOCK_BRANCHES
+//
+// Returns NULL if the file cannot be created
+//
+seekable_writer_t *seekable_create(const char *path, uint32_t frameBranches);
+
+// Append one binary trace block holding 'branches' branches, only the
+// last block may hold less than TRACE_BLOCK_BRANCHES
+//
+// Returns True if Successful
+//
+int seekable_add(seekable_writer_t *w, const uint8_t *block, uint32_t branches);
+
+// Write the last frame, the index and the header and close the file
+//
+// Returns True if Successful
+//
+int seekable_finish(seekable_writer_t *w);
+
+#endif
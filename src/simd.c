@@ -0,0 +1,250 @@
+//========================================================//
+//  simd.c                                                //
+//  Source file for the vectorized perceptron kernels     //
+//                                                        //
+//  Each kernel expands the input bits of a chunk of      //
+//  weights into a byte mask, negates the weights whose   //
+//  input is NOTTAKEN and sums them, or adds +1/-1 to     //
+//  every valid weight with saturation at +/-127.         //
+//  Rows are padded to 64 bytes, so whole chunks can be   //
+//  loaded; padding weights and input bits are zero.      //
+//========================================================//
+
+#include "helpers.h"
+#include "simd.h"
+
+const char *simdName[4] = {"scalar", "sse2", "avx2", "avx512"};
+
+int32_t (*perceptron_dot)(const int8_t *, const uint64_t *, int) = perceptron_output;
+void (*perceptron_train)(int8_t *, const uint64_t *, int, uint8_t) = perceptron_update;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+
+#define BYTE_BROADCAST 0x0101010101010101ULL
+#define BYTE_BITS      0x8040201008040201ULL
+
+// input bits of the lanes [base, base + width), width <= 64 and base a
+// multiple of width
+static inline uint64_t
+chunk_bits(const uint64_t *xbits, int base, int width) {
+    uint64_t word = xbits[base >> 6] >> (base & 63);
+    return (width == 64) ? word : word & (((uint64_t) 1 << width) - 1);
+}
+
+// lanes from 'base' on that are below 'length', one bit per lane
+static inline uint64_t
+chunk_valid(int base, int length) {
+    int n = length - base;
+    return (n >= 64) ? ~(uint64_t) 0 : ((uint64_t) 1 << n) - 1;
+}
+
+//------------------------------------//
+//               SSE2                 //
+//------------------------------------//
+
+// 0xff in byte i where bit i of 'bits' is set
+__attribute__((target("sse2")))
+static inline __m128i
+expand_sse2(uint64_t bits) {
+    __m128i sel = _mm_set1_epi64x((long long) BYTE_BITS);
+    __m128i v = _mm_set_epi64x((long long) (((bits >> 8) & 0xff) * BYTE_BROADCAST),
+                               (long long) ((bits & 0xff) * BYTE_BROADCAST));
+    return _mm_cmpeq_epi8(_mm_and_si128(v, sel), sel);
+}
+
+__attribute__((target("sse2")))
+static int32_t
+dot_sse2(const int8_t *weights, const uint64_t *xbits, int length) {
+    __m128i acc = _mm_setzero_si128();
+    __m128i ones = _mm_set1_epi16(1);
+
+    for (int base = 0; base < length; base += 16) {
+        __m128i w = _mm_load_si128((const __m128i *) (weights + base));
+        __m128i neg = _mm_xor_si128(expand_sse2(chunk_bits(xbits, base, 16)), _mm_set1_epi8(-1));
+        __m128i x = _mm_sub_epi8(_mm_xor_si128(w, neg), neg);
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_add_epi16(lo, hi), ones));
+    }
+
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+}
+
+__attribute__((target("sse2")))
+static void
+train_sse2(int8_t *weights, const uint64_t *xbits, int length, uint8_t outcome) {
+    __m128i one = _mm_set1_epi8(1);
+    __m128i minus = _mm_set1_epi8(-1);
+    __m128i floor = _mm_set1_epi8(-128);
+    __m128i flip = outcome ? _mm_setzero_si128() : minus;
+
+    for (int base = 0; base < length; base += 16) {
+        __m128i w = _mm_load_si128((const __m128i *) (weights + base));
+        __m128i agree = _mm_xor_si128(expand_sse2(chunk_bits(xbits, base, 16)), flip);
+        __m128i delta = _mm_or_si128(_mm_and_si128(agree, one), _mm_andnot_si128(agree, minus));
+        delta = _mm_and_si128(delta, expand_sse2(chunk_valid(base, length)));
+        w = _mm_adds_epi8(w, delta);
+        w = _mm_sub_epi8(w, _mm_cmpeq_epi8(w, floor));
+        _mm_store_si128((__m128i *) (weights + base), w);
+    }
+}
+
+//------------------------------------//
+//               AVX2                 //
+//------------------------------------//
+
+__attribute__((target("avx2")))
+static inline __m256i
+expand_avx2(uint64_t bits) {
+    __m256i sel = _mm256_set1_epi64x((long long) BYTE_BITS);
+    __m256i v = _mm256_set_epi64x((long long) (((bits >> 24) & 0xff) * BYTE_BROADCAST),
+                                  (long long) (((bits >> 16) & 0xff) * BYTE_BROADCAST),
+                                  (long long) (((bits >> 8) & 0xff) * BYTE_BROADCAST),
+                                  (long long) ((bits & 0xff) * BYTE_BROADCAST));
+    return _mm256_cmpeq_epi8(_mm256_and_si256(v, sel), sel);
+}
+
+__attribute__((target("avx2")))
+static int32_t
+dot_avx2(const int8_t *weights, const uint64_t *xbits, int length) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i ones8 = _mm256_set1_epi8(1);
+    __m256i ones16 = _mm256_set1_epi16(1);
+
+    for (int base = 0; base < length; base += 32) {
+        __m256i w = _mm256_load_si256((const __m256i *) (weights + base));
+        __m256i neg = _mm256_xor_si256(expand_avx2(chunk_bits(xbits, base, 32)), _mm256_set1_epi8(-1));
+        __m256i x = _mm256_sub_epi8(_mm256_xor_si256(w, neg), neg);
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, x), ones16));
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2")))
+static void
+train_avx2(int8_t *weights, const uint64_t *xbits, int length, uint8_t outcome) {
+    __m256i one = _mm256_set1_epi8(1);
+    __m256i minus = _mm256_set1_epi8(-1);
+    __m256i floor = _mm256_set1_epi8(-127);
+    __m256i flip = outcome ? _mm256_setzero_si256() : minus;
+
+    for (int base = 0; base < length; base += 32) {
+        __m256i w = _mm256_load_si256((const __m256i *) (weights + base));
+        __m256i agree = _mm256_xor_si256(expand_avx2(chunk_bits(xbits, base, 32)), flip);
+        __m256i delta = _mm256_blendv_epi8(minus, one, agree);
+        delta = _mm256_and_si256(delta, expand_avx2(chunk_valid(base, length)));
+        w = _mm256_max_epi8(_mm256_adds_epi8(w, delta), floor);
+        _mm256_store_si256((__m256i *) (weights + base), w);
+    }
+}
+
+//------------------------------------//
+//              AVX-512               //
+//------------------------------------//
+
+__attribute__((target("avx512f,avx512bw")))
+static int32_t
+dot_avx512(const int8_t *weights, const uint64_t *xbits, int length) {
+    __m512i acc = _mm512_setzero_si512();
+    __m512i ones8 = _mm512_set1_epi8(1);
+    __m512i ones16 = _mm512_set1_epi16(1);
+
+    for (int base = 0; base < length; base += 64) {
+        __m512i w = _mm512_load_si512((const void *) (weights + base));
+        __m512i neg = _mm512_sub_epi8(_mm512_setzero_si512(), w);
+        __m512i x = _mm512_mask_blend_epi8((__mmask64) xbits[base >> 6], neg, w);
+        acc = _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(ones8, x), ones16));
+    }
+    return _mm512_reduce_add_epi32(acc);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void
+train_avx512(int8_t *weights, const uint64_t *xbits, int length, uint8_t outcome) {
+    __m512i one = _mm512_set1_epi8(1);
+    __m512i minus = _mm512_set1_epi8(-1);
+    __m512i floor = _mm512_set1_epi8(-127);
+    uint64_t flip = outcome ? 0 : ~(uint64_t) 0;
+
+    for (int base = 0; base < length; base += 64) {
+        __m512i w = _mm512_load_si512((const void *) (weights + base));
+        __mmask64 agree = (__mmask64) (xbits[base >> 6] ^ flip);
+        __m512i delta = _mm512_mask_blend_epi8(agree, minus, one);
+        w = _mm512_mask_adds_epi8(w, (__mmask64) chunk_valid(base, length), w, delta);
+        w = _mm512_max_epi8(w, floor);
+        _mm512_store_si512((void *) (weights + base), w);
+    }
+}
+
+#endif
+
+//------------------------------------//
+//            Dispatching             //
+//------------------------------------//
+
+int
+simd_supported(int level) {
+    switch (level) {
+        case SIMD_SCALAR:
+            return 1;
+#ifdef SIMD_X86
+        case SIMD_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SIMD_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case SIMD_AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+        default:
+            return 0;
+    }
+}
+
+int
+simd_select(int level) {
+    if (!simd_supported(level)) {
+        return 0;
+    }
+
+    switch (level) {
+#ifdef SIMD_X86
+        case SIMD_SSE2:
+            perceptron_dot = dot_sse2;
+            perceptron_train = train_sse2;
+            break;
+        case SIMD_AVX2:
+            perceptron_dot = dot_avx2;
+            perceptron_train = train_avx2;
+            break;
+        case SIMD_AVX512:
+            perceptron_dot = dot_avx512;
+            perceptron_train = train_avx512;
+            break;
+#endif
+        default:
+            perceptron_dot = perceptron_output;
+            perceptron_train = perceptron_update;
+            break;
+    }
+    return 1;
+}
+
+int
+simd_init() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+#endif
+    int level = SIMD_AVX512;
+    while (!simd_select(level)) {
+        level--;
+    }
+    return level;
+}
@@ -0,0 +1,46 @@
+//========================================================//
+//  simd.h                                                //
+//  Header file for the vectorized perceptron kernels     //
+//                                                        //
+//  The kernels work on the flat perceptron rows and      //
+//  input bits described in helpers.h. The best kernel    //
+//  for the running CPU is picked by simd_init().         //
+//========================================================//
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+// Kernel levels, in order of preference
+#define SIMD_SCALAR  0
+#define SIMD_SSE2    1
+#define SIMD_AVX2    2
+#define SIMD_AVX512  3
+extern const char *simdName[];
+
+// Dot product of a row with the +1/-1 inputs, same as perceptron_output()
+//
+extern int32_t (*perceptron_dot)(const int8_t *weights, const uint64_t *xbits, int length);
+
+// Saturating weight update, same as perceptron_update()
+//
+extern void (*perceptron_train)(int8_t *weights, const uint64_t *xbits, int length, uint8_t outcome);
+
+// Select the best kernel supported by the CPU
+//
+// Returns the selected level
+//
+int simd_init();
+
+// True if the CPU supports kernel 'level'
+//
+int simd_supported(int level);
+
+// Select kernel 'level' (for testing and comparisons)
+//
+// Returns True if the CPU supports it
+//
+int simd_select(int level);
+
+#endif
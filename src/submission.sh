@@ -3,4 +3,4 @@ make clean
 
 FILENAME='hou_wang_a53241783.zip'
 rm $FILENAME
-zip -X $FILENAME *.c *.h Makefile
+zip -X $FILENAME *.c *.h *.def Makefile
@@ -0,0 +1,235 @@
+//========================================================//
+//  sweep.c                                               //
+//  Source file for the trace x configuration sweeps      //
+//                                                        //
+//  Jobs are dealt round-robin to one deque per worker.   //
+//  A worker takes jobs from the back of its own deque    //
+//  and, once it is empty, steals from the front of the   //
+//  other deques. No job creates new jobs, so a worker    //
+//  that finds every deque empty is done.                 //
+//========================================================//
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "sweep.h"
+#include "trace.h"
+
+// Branches simulated per predict_and_train call
+#define SWEEP_BATCH 4096
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *jobs;          // indices into the job array
+    int head;           // next job stolen by other workers
+    int tail;           // one past the next job of the owner
+} deque_t;
+
+typedef struct {
+    sweep_job_t *jobs;
+    deque_t *deques;
+    int workers;
+} sweep_t;
+
+typedef struct {
+    sweep_t *sweep;
+    int self;
+} worker_t;
+
+//------------------------------------//
+//             Scheduling             //
+//------------------------------------//
+
+// Next job for worker 'self', its own newest job or the oldest job of
+// another worker
+//
+// Returns the job index, or -1 if every deque is empty
+//
+static int
+next_job(sweep_t *sweep, int self) {
+    for (int k = 0; k < sweep->workers; k++) {
+        deque_t *deque = &sweep->deques[(self + k) % sweep->workers];
+        int job = -1;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail) {
+            job = (k == 0) ? deque->jobs[--deque->tail] : deque->jobs[deque->head++];
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        if (job >= 0) {
+            return job;
+        }
+    }
+    return -1;
+}
+
+//------------------------------------//
+//             Simulation             //
+//------------------------------------//
+
+// Simulate one job from the branches in memory
+static void
+run_memory_job(sweep_job_t *job) {
+    uint64_t count = job->count;
+    if (job->limit != 0 && job->limit < count) {
+        count = job->limit;
+    }
+
+    predictor_t *p = predictor_create(&job->config);
+    if (p == NULL) {
+        job->failed = 1;
+        return;
+    }
+    for (uint32_t i = 0; i < job->warmup; i += SWEEP_BATCH) {
+        size_t n = (job->warmup - i < SWEEP_BATCH) ? job->warmup - i : SWEEP_BATCH;
+        predict_and_train(p, job->pcs - job->warmup + i, job->outcomes - job->warmup + i, n, NULL);
+    }
+    for (uint64_t i = 0; i < count; i += SWEEP_BATCH) {
+        size_t n = (count - i < SWEEP_BATCH) ? count - i : SWEEP_BATCH;
+        job->mispredictions += predict_and_train(p, job->pcs + i, job->outcomes + i, n, NULL);
+    }
+    job->branches = count;
+    predictor_destroy(p);
+}
+
+// Simulate one job with its own trace reader and predictor instance
+static void
+run_job(sweep_job_t *job) {
+    if (job->pcs != NULL) {
+        run_memory_job(job);
+        return;
+    }
+
+    trace_t *trace = trace_open(job->trace, 1);
+    if (trace == NULL) {
+        job->failed = 1;
+        return;
+    }
+
+    if (job->start > 0 && !trace_seek(trace, job->start - job->warmup)) {
+        job->failed = 1;
+        trace_close(trace);
+        return;
+    }
+
+    predictor_t *p = predictor_create(&job->config);
+    if (p == NULL) {
+        job->failed = 1;
+        trace_close(trace);
+        return;
+    }
+    uint32_t pcs[SWEEP_BATCH];
+    uint8_t outcomes[SWEEP_BATCH];
+    size_t n;
+
+    // train on the branches before 'start' without counting them
+    for (uint32_t i = 0; job->start > 0 && i < job->warmup; i += n) {
+        n = trace_read_batch(trace, pcs, outcomes, (job->warmup - i < SWEEP_BATCH) ? job->warmup - i : SWEEP_BATCH);
+        if (n == 0) {
+            break;
+        }
+        predict_and_train(p, pcs, outcomes, n, NULL);
+    }
+
+    size_t batch = SWEEP_BATCH;
+
+    do {
+        if (job->limit != 0 && job->limit - job->branches < batch) {
+            batch = job->limit - job->branches;
+        }
+        n = trace_read_batch(trace, pcs, outcomes, batch);
+        job->branches += n;
+        job->mispredictions += predict_and_train(p, pcs, outcomes, n, NULL);
+    } while (n == SWEEP_BATCH);
+
+    // no numbers from a damaged trace
+    if (trace_error(trace)) {
+        job->failed = 1;
+    }
+    predictor_destroy(p);
+    trace_close(trace);
+}
+
+static void *
+work(void *arg) {
+    worker_t *worker = (worker_t *) arg;
+    int job;
+    while ((job = next_job(worker->sweep, worker->self)) >= 0) {
+        run_job(&worker->sweep->jobs[job]);
+    }
+    return NULL;
+}
+
+// Run 'n' jobs on 'threads' threads, each job stores its own result
+//
+void
+sweep_run(sweep_job_t *jobs, int n, int threads) {
+    if (n <= 0) {
+        return;
+    }
+    sweep_t sweep;
+    sweep.jobs = jobs;
+    sweep.workers = (threads < 1) ? 1 : (threads > n) ? n : threads;
+
+    // deal the jobs round-robin, so each worker starts on its own share
+    sweep.deques = (deque_t *) calloc(sweep.workers, sizeof(deque_t));
+    for (int w = 0; w < sweep.workers; w++) {
+        pthread_mutex_init(&sweep.deques[w].lock, NULL);
+        sweep.deques[w].jobs = (int *) malloc((n / sweep.workers + 1) * sizeof(int));
+    }
+    for (int i = 0; i < n; i++) {
+        jobs[i].branches = 0;
+        jobs[i].mispredictions = 0;
+        jobs[i].failed = 0;
+        deque_t *deque = &sweep.deques[i % sweep.workers];
+        deque->jobs[deque->tail++] = i;
+    }
+
+    // the calling thread is worker 0
+    pthread_t *tids = (pthread_t *) malloc(sweep.workers * sizeof(pthread_t));
+    worker_t *workers = (worker_t *) malloc(sweep.workers * sizeof(worker_t));
+    for (int w = 0; w < sweep.workers; w++) {
+        workers[w].sweep = &sweep;
+        workers[w].self = w;
+        if (w > 0) {
+            pthread_create(&tids[w], NULL, work, &workers[w]);
+        }
+    }
+    work(&workers[0]);
+    for (int w = 1; w < sweep.workers; w++) {
+        pthread_join(tids[w], NULL);
+    }
+
+    for (int w = 0; w < sweep.workers; w++) {
+        pthread_mutex_destroy(&sweep.deques[w].lock);
+        free(sweep.deques[w].jobs);
+    }
+    free(sweep.deques);
+    free(tids);
+    free(workers);
+}
+
+//------------------------------------//
+//               Output               //
+//------------------------------------//
+
+// Print the results as one tab separated table with a header line,
+// in the order of 'jobs'
+//
+void
+sweep_print(FILE *out, const sweep_job_t *jobs, int n) {
+    char name[64];
+    fprintf(out, "trace\tconfig\tbits\tbranches\tincorrect\tmispredict_rate\n");
+    for (int i = 0; i < n; i++) {
+        predictor_config_name(&jobs[i].config, name, sizeof(name));
+        unsigned long long bits = predictor_config_bits(&jobs[i].config);
+        if (jobs[i].failed) {
+            fprintf(out, "%s\t%s\t%llu\t-\t-\t-\n", jobs[i].trace, name, bits);
+            continue;
+        }
+        float mispredict_rate = 100 * ((float) jobs[i].mispredictions / (float) jobs[i].branches);
+        fprintf(out, "%s\t%s\t%llu\t%llu\t%llu\t%.3f\n", jobs[i].trace, name, bits,
+                (unsigned long long) jobs[i].branches, (unsigned long long) jobs[i].mispredictions,
+                mispredict_rate);
+    }
+}
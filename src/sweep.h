@@ -0,0 +1,43 @@
+//========================================================//
+//  sweep.h                                               //
+//  Header file for the trace x configuration sweeps      //
+//                                                        //
+//  Every (trace, configuration) pair is one job. Jobs    //
+//  run on a pool of work-stealing threads and store      //
+//  their result in their own slot, so the table does     //
+//  not depend on the number of threads.                  //
+//========================================================//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "predictor.h"
+
+// One simulation of a trace with a predictor configuration
+typedef struct {
+    const char *trace;            // trace file
+    uint64_t start;               // first branch of 'trace' simulated
+    const uint32_t *pcs;          // branches already in memory, read instead
+    const uint8_t *outcomes;      // of 'trace' if not NULL
+    uint64_t count;
+    uint32_t warmup;              // branches before 'pcs' (or 'start') that
+                                  // train the predictor first but are not counted
+    predictor_config_t config;
+    uint64_t limit;               // simulate only this many branches, 0 for all
+    uint64_t branches;            // result, number of branches
+    uint64_t mispredictions;      // result, number of mispredictions
+    int failed;                   // the trace could not be opened
+} sweep_job_t;
+
+// Run 'n' jobs on 'threads' threads, each job stores its own result
+//
+void sweep_run(sweep_job_t *jobs, int n, int threads);
+
+// Print the results as one tab separated table with a header line,
+// in the order of 'jobs'
+//
+void sweep_print(FILE *out, const sweep_job_t *jobs, int n);
+
+#endif
@@ -0,0 +1,256 @@
+//========================================================//
+//  tage.c                                                //
+//  Source file for the TAGE predictor                    //
+//                                                        //
+//  The provider is the matching table with the longest   //
+//  history, the alternate the next matching one (or the  //
+//  base). On a misprediction one entry is allocated in   //
+//  a longer table whose useful counter is 0. Useful      //
+//  counters are halved every 2^TAGE_TICK_BITS branches.  //
+//========================================================//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predictor.h"
+#include "helpers.h"
+#include "tage.h"
+
+// Circular global history, long enough for TAGE_MAX_HISTORY + 1 bits
+#define TAGE_HISTORY_BUFFER 2048
+
+#define CTR_MAX     ((1 << (TAGE_CTR_BITS - 1)) - 1)
+#define CTR_MIN     (-(1 << (TAGE_CTR_BITS - 1)))
+#define U_MAX       ((1 << TAGE_U_BITS) - 1)
+#define USE_ALT_MAX ((1 << (TAGE_USE_ALT_BITS - 1)) - 1)
+#define USE_ALT_MIN (-(1 << (TAGE_USE_ALT_BITS - 1)))
+
+typedef struct {
+    int8_t ctr;         // prediction, taken if >= 0
+    uint8_t u;          // useful
+    uint16_t tag;
+} tage_entry_t;
+
+struct tage {
+    int tables;
+    int indexBits;
+    int tagBits;
+    uint32_t indexMask;
+    uint32_t tagMask;
+    int historyLength[TAGE_MAX_TABLES];
+    tage_entry_t *entries;      // table i starts at entry i << indexBits
+
+    uint8_t *base;              // bimodal 2-bit counters
+    uint32_t baseMask;
+
+    uint8_t history[TAGE_HISTORY_BUFFER];   // history[head] is the newest outcome
+    uint32_t head;
+    folded_history_t indexFold[TAGE_MAX_TABLES];
+    folded_history_t tagFold[TAGE_MAX_TABLES];
+    folded_history_t tagFold2[TAGE_MAX_TABLES];     // one bit narrower
+
+    int8_t useAltOnNa;          // >= 0 to trust the alternate over new entries
+    uint32_t tick;
+    uint32_t seed;              // allocation choice, deterministic
+};
+
+static void
+init_fold(folded_history_t *f, int length, int width) {
+    f->value = 0;
+    f->width = width;
+    f->length = length;
+    f->outpoint = length % width;
+}
+
+// History length of tagged table 'i'
+//
+int
+tage_history_length(int tables, int minHistory, int maxHistory, int i) {
+    if (tables == 1) {
+        return maxHistory;
+    }
+    double ratio = pow((double) maxHistory / minHistory, (double) i / (tables - 1));
+    return (int) (minHistory * ratio + 0.5);
+}
+
+// Arena bytes taken by tage_create() for these table sizes
+//
+size_t
+tage_arena_bytes(int tables, int indexBits) {
+    return arena_round(sizeof(tage_t)) +
+           arena_round(((size_t) tables << indexBits) * sizeof(tage_entry_t)) +
+           arena_round(power(indexBits + 2));
+}
+
+// Create a TAGE predictor, the arena is zeroed so only the base
+// counters need a value
+//
+tage_t *
+tage_create(arena_t *arena, int tables, int indexBits, int tagBits, int minHistory, int maxHistory) {
+    tage_t *t = (tage_t *) arena_alloc(arena, sizeof(tage_t));
+    t->tables = tables;
+    t->indexBits = indexBits;
+    t->tagBits = tagBits;
+    t->indexMask = left_shift(indexBits);
+    t->tagMask = left_shift(tagBits);
+
+    t->entries = (tage_entry_t *) arena_alloc(arena, ((size_t) tables << indexBits) * sizeof(tage_entry_t));
+    for (int i = 0; i < tables; i++) {
+        t->historyLength[i] = tage_history_length(tables, minHistory, maxHistory, i);
+        init_fold(&t->indexFold[i], t->historyLength[i], indexBits);
+        init_fold(&t->tagFold[i], t->historyLength[i], tagBits);
+        init_fold(&t->tagFold2[i], t->historyLength[i], tagBits - 1);
+    }
+
+    t->baseMask = left_shift(indexBits + 2);
+    t->base = (uint8_t *) arena_alloc(arena, power(indexBits + 2));
+    init_counter(t->base, power(indexBits + 2));
+    t->seed = 1;
+    return t;
+}
+
+static inline tage_entry_t *
+entry(tage_t *t, int table, uint32_t index) {
+    return &t->entries[((size_t) table << t->indexBits) + index];
+}
+
+// weak entries that were never useful are likely newly allocated
+static inline int
+newly_allocated(const tage_entry_t *e) {
+    return (e->ctr == 0 || e->ctr == -1) && e->u == 0;
+}
+
+// Predict the branch at 'pc' and fill 'ctx'
+//
+uint8_t
+tage_lookup(tage_t *t, uint32_t pc, tage_lookup_t *ctx) {
+    for (int i = 0; i < t->tables; i++) {
+        ctx->index[i] = (pc ^ (pc >> t->indexBits) ^ t->indexFold[i].value) & t->indexMask;
+        ctx->tag[i] = (uint16_t) ((pc ^ t->tagFold[i].value ^ (t->tagFold2[i].value << 1)) & t->tagMask);
+    }
+    ctx->baseIndex = pc & t->baseMask;
+
+    // the two longest matching tables
+    ctx->provider = -1;
+    ctx->alternate = -1;
+    for (int i = t->tables - 1; i >= 0; i--) {
+        if (entry(t, i, ctx->index[i])->tag == ctx->tag[i]) {
+            if (ctx->provider < 0) {
+                ctx->provider = i;
+            } else {
+                ctx->alternate = i;
+                break;
+            }
+        }
+    }
+
+    uint8_t basePrediction = parse_prediction_entry(t->base[ctx->baseIndex]);
+    ctx->alternatePrediction = (ctx->alternate >= 0) ?
+                               entry(t, ctx->alternate, ctx->index[ctx->alternate])->ctr >= 0 : basePrediction;
+    if (ctx->provider < 0) {
+        ctx->providerPrediction = basePrediction;
+        return ctx->prediction = basePrediction;
+    }
+
+    const tage_entry_t *e = entry(t, ctx->provider, ctx->index[ctx->provider]);
+    ctx->providerPrediction = e->ctr >= 0;
+    if (newly_allocated(e) && t->useAltOnNa >= 0) {
+        return ctx->prediction = ctx->alternatePrediction;
+    }
+    return ctx->prediction = ctx->providerPrediction;
+}
+
+static inline int8_t
+saturate(int value, int min, int max) {
+    return (int8_t) ((value > max) ? max : (value < min) ? min : value);
+}
+
+// allocate an entry in a table longer than the provider
+static void
+allocate(tage_t *t, const tage_lookup_t *ctx, uint8_t outcome) {
+    // start one table further half of the time, so the longest table
+    // does not always win
+    t->seed = t->seed * 1103515245 + 12345;
+    int start = ctx->provider + 1 + ((t->seed >> 16) & 1);
+    if (start >= t->tables) {
+        start = ctx->provider + 1;
+    }
+
+    for (int i = start; i < t->tables; i++) {
+        tage_entry_t *e = entry(t, i, ctx->index[i]);
+        if (e->u == 0) {
+            e->tag = ctx->tag[i];
+            e->ctr = outcome ? 0 : -1;
+            return;
+        }
+    }
+
+    // no free entry, make room for the next time
+    for (int i = ctx->provider + 1; i < t->tables; i++) {
+        tage_entry_t *e = entry(t, i, ctx->index[i]);
+        if (e->u > 0) {
+            e->u--;
+        }
+    }
+}
+
+// shift the outcome into the history and every folded history
+static inline void
+shift_history(tage_t *t, uint8_t outcome) {
+    t->head = (t->head - 1) & (TAGE_HISTORY_BUFFER - 1);
+    t->history[t->head] = outcome;
+    for (int i = 0; i < t->tables; i++) {
+        uint8_t oldest = t->history[(t->head + t->historyLength[i]) & (TAGE_HISTORY_BUFFER - 1)];
+        folded_history_update(&t->indexFold[i], outcome, oldest);
+        folded_history_update(&t->tagFold[i], outcome, oldest);
+        folded_history_update(&t->tagFold2[i], outcome, oldest);
+    }
+}
+
+// Train with the outcome of the branch looked up in 'ctx'
+//
+void
+tage_update(tage_t *t, const tage_lookup_t *ctx, uint8_t outcome) {
+    if (ctx->prediction != outcome && ctx->provider < t->tables - 1) {
+        allocate(t, ctx, outcome);
+    }
+
+    if (ctx->provider >= 0) {
+        tage_entry_t *e = entry(t, ctx->provider, ctx->index[ctx->provider]);
+
+        // learn whether new entries or their alternates are better
+        if (newly_allocated(e) && ctx->providerPrediction != ctx->alternatePrediction) {
+            int delta = (ctx->alternatePrediction == outcome) ? 1 : -1;
+            t->useAltOnNa = saturate(t->useAltOnNa + delta, USE_ALT_MIN, USE_ALT_MAX);
+        }
+
+        // the provider is useful when it beats the alternate
+        if (ctx->providerPrediction != ctx->alternatePrediction) {
+            int u = e->u + ((ctx->providerPrediction == outcome) ? 1 : -1);
+            e->u = (uint8_t) saturate(u, 0, U_MAX);
+        }
+        e->ctr = saturate(e->ctr + (outcome ? 1 : -1), CTR_MIN, CTR_MAX);
+    } else {
+        t->base[ctx->baseIndex] = next_state(t->base[ctx->baseIndex], outcome);
+    }
+
+    // age the useful counters
+    if (++t->tick == (1u << TAGE_TICK_BITS)) {
+        t->tick = 0;
+        for (size_t k = 0; k < ((size_t) t->tables << t->indexBits); k++) {
+            t->entries[k].u >>= 1;
+        }
+    }
+
+    shift_history(t, outcome);
+}
+
+// Shift 'n' outcomes into the histories without reading or training
+// any table
+//
+void
+tage_skip(tage_t *t, const uint8_t *outcomes, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        shift_history(t, outcomes[i]);
+    }
+}
@@ -0,0 +1,98 @@
+//========================================================//
+//  tage.h                                                //
+//  Header file for the TAGE predictor                    //
+//                                                        //
+//  A bimodal base table plus tagged tables indexed with  //
+//  geometrically longer global histories. Indices and    //
+//  tags use folded histories that are updated in O(1)    //
+//  per table and branch, whatever the history length.    //
+//========================================================//
+
+#ifndef TAGE_H
+#define TAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define TAGE_MAX_TABLES   16
+#define TAGE_MAX_HISTORY  1023
+#define TAGE_MAX_INDEX    24
+#define TAGE_MAX_TAG      16
+
+// Default "tage" configuration
+#define TAGE_TABLES       7
+#define TAGE_INDEX_BITS   10
+#define TAGE_TAG_BITS     11
+#define TAGE_MIN_HISTORY  4
+#define TAGE_MAX_LENGTH   640
+
+// Entry widths in bits
+#define TAGE_CTR_BITS     3   // signed prediction counter
+#define TAGE_U_BITS       2   // useful counter
+#define TAGE_BASE_BITS    2   // bimodal counter
+#define TAGE_USE_ALT_BITS 4   // use_alt_on_na counter
+#define TAGE_TICK_BITS    18  // branches between useful counter resets
+
+// A history of 'length' bits folded into 'width' bits: bit j of the
+// history (0 the most recent) is xored into bit j % width
+typedef struct {
+    uint32_t value;
+    int width;
+    int length;
+    int outpoint;       // length % width
+} folded_history_t;
+
+// What tage_lookup() found for one branch, consumed by tage_update()
+typedef struct {
+    uint32_t index[TAGE_MAX_TABLES];
+    uint16_t tag[TAGE_MAX_TABLES];
+    uint32_t baseIndex;
+    int provider;       // longest matching table, -1 for the base
+    int alternate;      // next matching table, -1 for the base
+    uint8_t providerPrediction;
+    uint8_t alternatePrediction;
+    uint8_t prediction;
+} tage_lookup_t;
+
+typedef struct tage tage_t;
+
+// Arena bytes taken by tage_create() for these table sizes
+//
+size_t tage_arena_bytes(int tables, int indexBits);
+
+// Create a TAGE predictor with 'tables' tagged tables of 2^indexBits
+// entries and 'tagBits' tags, histories from 'minHistory' to
+// 'maxHistory' bits and a base table of 2^(indexBits + 2) counters.
+// Its state and tables come from 'arena' and are freed with it.
+//
+tage_t *tage_create(arena_t *arena, int tables, int indexBits, int tagBits, int minHistory, int maxHistory);
+
+// Predict the branch at 'pc' and fill 'ctx'
+//
+uint8_t tage_lookup(tage_t *t, uint32_t pc, tage_lookup_t *ctx);
+
+// Train with the outcome of the branch looked up in 'ctx'
+//
+void tage_update(tage_t *t, const tage_lookup_t *ctx, uint8_t outcome);
+
+// Shift 'n' outcomes into the histories without reading or training
+// any table
+//
+void tage_skip(tage_t *t, const uint8_t *outcomes, size_t n);
+
+// History length of tagged table 'i'
+//
+int tage_history_length(int tables, int minHistory, int maxHistory, int i);
+
+// Fold one history bit into 'f', 'oldest' is the bit that leaves the
+// window of f->length bits
+static inline void
+folded_history_update(folded_history_t *f, uint8_t newest, uint8_t oldest) {
+    f->value = (f->value << 1) | newest;
+    f->value ^= (uint32_t) oldest << f->outpoint;
+    f->value ^= f->value >> f->width;
+    f->value &= ((uint32_t) 1 << f->width) - 1;
+}
+
+#endif
@@ -0,0 +1,1119 @@
+//========================================================//
+//  trace.c                                               //
+//  Source file for the branch trace readers              //
+//                                                        //
+//  Text traces are read in blocks of several megabytes,  //
+//  newlines are found 64 bytes at a time with SSE2 and   //
+//  the PCs decoded 8 digits at a time. Binary traces     //
+//  are mmapped when they are regular files and streamed  //
+//  block by block otherwise (pipes). bzip2 traces are    //
+//  decompressed in parallel and parsed chunk by chunk.   //
+//  Seekable traces hand out the blocks of their frames.  //
+//  Dictionary traces decode one varint per branch.       //
+//========================================================//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "pbzip.h"
+#include "seekable.h"
+#include "trace.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Text block size, and readable bytes past the end of the block so
+// the newline scan and the PC decoder never check the length
+#ifndef TEXT_BLOCK_BYTES
+#define TEXT_BLOCK_BYTES  (4 << 20)
+#endif
+#define TEXT_PADDING      64
+
+// Dictionary trace buffer when streaming, and the longest varint
+#define DICT_BUFFER_BYTES (1 << 20)
+#define VARINT_MAX_BYTES  5
+
+// Branches read at a time by the converters that do not fill blocks
+#define CONVERT_BATCH     4096
+
+// Dense IDs of PCs in order of first appearance
+typedef struct {
+    uint64_t *slots;           // PC << 32 | ID + 1, open addressing, 0 is empty
+    int bits;                  // the table has 2^bits slots
+    uint32_t *pcs;             // PC of every ID
+    uint32_t size;
+    uint32_t cap;
+} id_map_t;
+
+struct trace {
+    int format;
+    int error;                 // the body was found truncated or corrupt
+    FILE *stream;
+    pbzip_t *pbz;              // decompressor for bzip2 traces, NULL otherwise
+    seekable_t *seek;          // frame decoder for seekable traces, NULL otherwise
+
+    // decompressed chunk or frame being consumed
+    const uint8_t *cur;
+    const uint8_t *end;
+
+    // text traces, a block of whole lines and the partial line at its end
+    char *text;
+    size_t textLen;            // bytes in the block
+    size_t textCap;
+    size_t lineStart;          // first byte of the next line
+    size_t scanned;            // bytes searched for newlines
+    size_t window;             // first byte of the last 64 searched
+    uint64_t newlines;         // newlines in the window not parsed yet
+    int textEnd;               // the stream is exhausted
+    trace_stats_t stats;
+
+    // binary traces
+    uint64_t count;            // branches in the trace
+    uint64_t index;            // branches read so far
+    uint64_t expected;         // checksum from the header
+    uint64_t checksum;         // checksum of the blocks read so far
+    int unchecked;             // seekable or seeked, no whole trace checksum
+    uint8_t *map;              // mmapped file, NULL when streaming
+    size_t mapLen;
+    const uint8_t *next;       // next block in the mapping
+    uint8_t *block;            // block buffer when streaming
+    const uint32_t *pcs;       // PCs of the current block
+    uint64_t outcomes;         // outcome bits of the current block
+    uint32_t slot;             // next branch in the current block
+    uint32_t slots;            // branches in the current block
+
+    // dictionary traces
+    uint32_t *dict;            // PC of every branch ID
+    uint32_t dictSize;
+    const uint8_t *in;         // varints not decoded yet
+    const uint8_t *inEnd;
+    uint8_t *inBuf;            // varint buffer when streaming
+    int inDone;                // no more varints to read
+
+    id_map_t ids;              // IDs of traces without a dictionary
+};
+
+//------------------------------------//
+//            Branch IDs              //
+//------------------------------------//
+
+static void
+id_map_init(id_map_t *map) {
+    map->bits = 12;
+    map->slots = (uint64_t *) calloc((size_t) 1 << map->bits, sizeof(uint64_t));
+    map->cap = 1024;
+    map->pcs = (uint32_t *) malloc(map->cap * sizeof(uint32_t));
+    map->size = 0;
+}
+
+static inline uint32_t
+id_slot(uint32_t pc, int bits) {
+    return (pc * 0x9e3779b1u) >> (32 - bits);
+}
+
+// ID of 'pc', the next one if it was never seen
+static inline uint32_t
+id_of(id_map_t *map, uint32_t pc) {
+    uint32_t mask = (1u << map->bits) - 1;
+    uint32_t slot = id_slot(pc, map->bits);
+    for (uint64_t entry; (entry = map->slots[slot]) != 0; slot = (slot + 1) & mask) {
+        if ((uint32_t) (entry >> 32) == pc) {
+            return (uint32_t) entry - 1;
+        }
+    }
+
+    if (map->size == map->cap) {
+        map->cap *= 2;
+        map->pcs = (uint32_t *) realloc(map->pcs, map->cap * sizeof(uint32_t));
+    }
+    map->pcs[map->size] = pc;
+    map->slots[slot] = (uint64_t) pc << 32 | ++map->size;
+
+    // double the table at half load
+    if (2 * map->size > mask + 1) {
+        free(map->slots);
+        map->bits++;
+        mask = (1u << map->bits) - 1;
+        map->slots = (uint64_t *) calloc((size_t) mask + 1, sizeof(uint64_t));
+        for (uint32_t id = 0; id < map->size; id++) {
+            for (slot = id_slot(map->pcs[id], map->bits); map->slots[slot] != 0; slot = (slot + 1) & mask) {
+            }
+            map->slots[slot] = (uint64_t) map->pcs[id] << 32 | (id + 1);
+        }
+    }
+    return map->size - 1;
+}
+
+static void
+id_map_free(id_map_t *map) {
+    free(map->slots);
+    free(map->pcs);
+}
+
+//------------------------------------//
+//        Decompressed Chunks         //
+//------------------------------------//
+
+// Move to the next decompressed chunk, returns False at the end
+static int
+next_chunk(trace_t *trace) {
+    const uint8_t *data;
+    size_t len;
+    int ret;
+
+    while ((ret = pbzip_next(trace->pbz, &data, &len)) == 1 && len == 0) {
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Corrupt bzip2 block in trace\n");
+        trace->error = 1;
+    }
+    if (ret != 1) {
+        trace->cur = trace->end = NULL;
+        return 0;
+    }
+
+    trace->cur = data;
+    trace->end = data + len;
+    return 1;
+}
+
+// Read 'n' bytes from the stream or the decompressed chunks
+//
+// Returns True if Successful
+//
+static int
+read_bytes(trace_t *trace, void *dst, size_t n) {
+    if (trace->pbz == NULL) {
+        return fread(dst, 1, n, trace->stream) == n;
+    }
+
+    uint8_t *out = (uint8_t *) dst;
+    while (n > 0) {
+        if (trace->cur == trace->end && !next_chunk(trace)) {
+            return 0;
+        }
+        size_t take = trace->end - trace->cur;
+        take = (take < n) ? take : n;
+        memcpy(out, trace->cur, take);
+        trace->cur += take;
+        out += take;
+        n -= take;
+    }
+    return 1;
+}
+
+// Read up to 'max' bytes from the stream or the decompressed chunks
+//
+// Returns the number of bytes read, 0 at the end
+//
+static size_t
+read_some(trace_t *trace, void *dst, size_t max) {
+    if (trace->pbz == NULL) {
+        return fread(dst, 1, max, trace->stream);
+    }
+    if (trace->cur == trace->end && !next_chunk(trace)) {
+        return 0;
+    }
+    size_t n = trace->end - trace->cur;
+    n = (n < max) ? n : max;
+    memcpy(dst, trace->cur, n);
+    trace->cur += n;
+    return n;
+}
+
+// Map the stream if it is a regular file longer than 'offset' bytes
+//
+// Returns True if Successful
+//
+static int
+map_stream(trace_t *trace, size_t offset) {
+    struct stat st;
+    int fd = fileno(trace->stream);
+    if (trace->pbz != NULL || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= (off_t) offset) {
+        return 0;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    trace->map = map;
+    trace->mapLen = st.st_size;
+    return 1;
+}
+
+//------------------------------------//
+//           Text Traces              //
+//------------------------------------//
+
+// Parse "0x<hex> <outcome>" in [p, end)
+//
+// Returns True if the line is well formed
+//
+static int
+parse_line(const char *p, const char *end, uint32_t *pc, uint8_t *outcome) {
+    if (end - p < 5 || p[0] != '0' || (p[1] != 'x' && p[1] != 'X')) {
+        return 0;
+    }
+
+    uint32_t value = 0;
+    const char *digits = p += 2;
+    for (; p < end; p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9') {
+            value = (value << 4) | (c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            value = (value << 4) | ((c | 0x20) - 'a' + 10);
+        } else {
+            break;
+        }
+    }
+    if (p == digits) {
+        return 0;
+    }
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    if (p == end || (*p != '0' && *p != '1')) {
+        return 0;
+    }
+
+    *pc = value;
+    *outcome = *p - '0';
+    return 1;
+}
+
+#define BYTES_01  0x0101010101010101ULL
+#define BYTES_0F  0x0f0f0f0f0f0f0f0fULL
+#define BYTES_80  0x8080808080808080ULL
+
+// high bit of every byte of 'x' that is >= 'n', for bytes below 0x80
+#define BYTES_GE(x, n) ((((x) | BYTES_80) - (n) * BYTES_01) & BYTES_80)
+
+// Decode the hex digits at 'p', 8 bytes at a time without a branch per
+// digit: a byte mask of the digits gives their count, every byte is
+// turned into its nibble and the nibbles are packed in three steps
+//
+// Returns the number of digits (at most 8), 'value' gets their value
+//
+static inline int
+parse_hex8(const char *p, uint32_t *value) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+
+    uint64_t lower = x | (0x20 * BYTES_01);
+    uint64_t decimal = BYTES_GE(x, '0') & ~BYTES_GE(x, '9' + 1);
+    uint64_t alpha = BYTES_GE(lower, 'a') & ~BYTES_GE(lower, 'f' + 1);
+    uint64_t bad = (~(decimal | alpha) | x) & BYTES_80;
+    int digits = (bad != 0) ? __builtin_ctzll(bad) >> 3 : 8;
+
+    // '0'-'9' -> 0-9, 'a'-'f' and 'A'-'F' -> 10-15, first digit on top
+    uint64_t v = ((x & BYTES_0F) + 9 * ((x >> 6) & BYTES_01)) & BYTES_0F;
+    v = __builtin_bswap64(v);
+    v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+    v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+    *value = (uint32_t) (v >> (32 - 4 * digits));
+    return digits;
+}
+
+// Parse the line [p, end), which may be followed by at least 16
+// readable bytes. Lines with more than 8 digits or several spaces take
+// the slow path.
+//
+// Returns True if the line is well formed
+//
+static inline int
+parse_text_line(const char *p, const char *end, uint32_t *pc, uint8_t *outcome) {
+    uint32_t value;
+    int digits = parse_hex8(p + 2, &value);
+    const char *o = p + 3 + digits;
+    if (o < end && digits > 0 && p[0] == '0' && (p[1] | 0x20) == 'x' && o[-1] == ' ' &&
+        (*o == '0' || *o == '1')) {
+        *pc = value;
+        *outcome = *o - '0';
+        return 1;
+    }
+    return parse_line(p, end, pc, outcome);
+}
+
+// Bit i is set if p[i] is a newline, for the 64 bytes at 'p'
+static inline uint64_t
+newline_mask(const char *p) {
+    uint64_t mask = 0;
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (int k = 0; k < 4; k++) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (p + 16 * k));
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, nl)) << (16 * k);
+    }
+#else
+    for (int i = 0; i < 64; i++) {
+        mask |= (uint64_t) (p[i] == '\n') << i;
+    }
+#endif
+    return mask;
+}
+
+static double
+seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Move the partial line to the front of the block and append the next
+// bytes of the stream or of the decompressed chunks
+//
+// Returns the number of bytes appended, 0 at the end
+//
+static size_t
+fill_text(trace_t *trace) {
+    size_t partial = trace->textLen - trace->lineStart;
+    memmove(trace->text, trace->text + trace->lineStart, partial);
+    trace->textLen = trace->scanned = partial;
+    trace->lineStart = 0;
+    if (trace->textEnd) {
+        return 0;
+    }
+
+    // a line longer than the block
+    if (trace->textLen == trace->textCap) {
+        trace->textCap *= 2;
+        trace->text = (char *) realloc(trace->text, trace->textCap + TEXT_PADDING);
+        memset(trace->text + trace->textCap, 0, TEXT_PADDING);
+    }
+
+    double start = seconds();
+    size_t n = read_some(trace, trace->text + trace->textLen, trace->textCap - trace->textLen);
+    trace->stats.readSeconds += seconds() - start;
+
+    trace->textEnd = (n == 0);
+    trace->textLen += n;
+    trace->stats.bytes += n;
+    return n;
+}
+
+// Parse up to 'max' lines, skipping malformed ones
+static size_t
+read_text(trace_t *trace, uint32_t *pcs, uint8_t *outcomes, size_t max) {
+    if (trace->text == NULL) {
+        trace->textCap = TEXT_BLOCK_BYTES;
+        trace->text = (char *) calloc(trace->textCap + TEXT_PADDING, 1);
+    }
+
+    size_t n = 0;
+    while (n < max) {
+        if (trace->newlines == 0) {
+            if (trace->scanned < trace->textLen) {
+                size_t len = trace->textLen - trace->scanned;
+                trace->window = trace->scanned;
+                trace->newlines = newline_mask(trace->text + trace->window);
+                if (len < 64) {
+                    trace->newlines &= (1ULL << len) - 1;
+                    trace->scanned += len;
+                } else {
+                    trace->scanned += 64;
+                }
+            } else if (fill_text(trace) == 0) {
+                // last line without a newline
+                if (trace->lineStart < trace->textLen) {
+                    trace->stats.lines++;
+                    if (parse_text_line(trace->text + trace->lineStart, trace->text + trace->textLen,
+                                        &pcs[n], &outcomes[n])) {
+                        n++;
+                    } else {
+                        trace->stats.malformed++;
+                    }
+                    trace->lineStart = trace->textLen;
+                }
+                break;
+            }
+            continue;
+        }
+
+        size_t nl = trace->window + __builtin_ctzll(trace->newlines);
+        trace->newlines &= trace->newlines - 1;
+        trace->stats.lines++;
+        if (parse_text_line(trace->text + trace->lineStart, trace->text + nl, &pcs[n], &outcomes[n])) {
+            n++;
+        } else {
+            trace->stats.malformed++;
+        }
+        trace->lineStart = nl + 1;
+    }
+    return n;
+}
+
+//------------------------------------//
+//         Dictionary Traces          //
+//------------------------------------//
+
+// Move the undecoded bytes to the front of the buffer and read more,
+// until a whole varint is buffered or the stream ends
+static void
+fill_dict(trace_t *trace) {
+    size_t left = trace->inEnd - trace->in;
+    memmove(trace->inBuf, trace->in, left);
+    size_t n;
+    do {
+        n = read_some(trace, trace->inBuf + left, DICT_BUFFER_BYTES - left);
+        left += n;
+    } while (n > 0 && left < VARINT_MAX_BYTES);
+
+    trace->inDone = (n == 0);
+    trace->in = trace->inBuf;
+    trace->inEnd = trace->inBuf + left;
+}
+
+// Decode up to 'max' branches
+static size_t
+read_dict(trace_t *trace, uint32_t *pcs, uint32_t *ids, uint8_t *outcomes, size_t max) {
+    size_t n = 0;
+    for (; n < max && trace->index < trace->count; n++) {
+        if (trace->inEnd - trace->in < VARINT_MAX_BYTES && !trace->inDone) {
+            fill_dict(trace);
+        }
+
+        uint32_t value = 0;
+        uint8_t byte;
+        int shift = 0;
+        do {
+            if (trace->in == trace->inEnd) {
+                fprintf(stderr, "Dictionary trace is truncated\n");
+                trace->error = 1;
+                trace->count = trace->index;
+                return n;
+            }
+            byte = *trace->in++;
+            value |= (uint32_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && shift < 7 * VARINT_MAX_BYTES);
+
+        uint32_t id = value >> 1;
+        if (id >= trace->dictSize) {
+            fprintf(stderr, "Corrupt dictionary trace\n");
+            trace->error = 1;
+            trace->count = trace->index;
+            return n;
+        }
+        pcs[n] = trace->dict[id];
+        outcomes[n] = value & 1;
+        if (ids != NULL) {
+            ids[n] = id;
+        }
+        trace->checksum = trace_checksum(trace->checksum, value);
+        trace->index++;
+    }
+
+    if (trace->index == trace->count && !trace->unchecked) {
+        if (trace->checksum != trace->expected) {
+            fprintf(stderr, "Dictionary trace checksum mismatch\n");
+            trace->error = 1;
+        }
+        trace->unchecked = 1;
+    }
+    return n;
+}
+
+// Read the dictionary and map the varints if the stream is a regular file
+static int
+open_dict(trace_t *trace, const trace_header_t *binaryHeader) {
+    trace_dict_header_t header;
+    memcpy(&header, binaryHeader, sizeof(header));
+    if (header.version != TRACE_DICT_VERSION) {
+        fprintf(stderr, "Bad dictionary trace header\n");
+        return 0;
+    }
+
+    trace->format = TRACE_DICTIONARY;
+    trace->count = header.count;
+    trace->expected = header.checksum;
+    trace->checksum = TRACE_CHECKSUM_SEED;
+    trace->dictSize = header.pcs;
+    trace->dict = (uint32_t *) malloc((size_t) header.pcs * sizeof(uint32_t) + 1);
+
+    size_t body = sizeof(header) + (size_t) header.pcs * sizeof(uint32_t);
+    if (map_stream(trace, body - 1)) {
+        memcpy(trace->dict, trace->map + sizeof(header), (size_t) header.pcs * sizeof(uint32_t));
+        trace->in = trace->map + body;
+        trace->inEnd = trace->map + trace->mapLen;
+        trace->inDone = 1;
+        return 1;
+    }
+
+    if (!read_bytes(trace, trace->dict, (size_t) header.pcs * sizeof(uint32_t))) {
+        fprintf(stderr, "Dictionary trace is truncated\n");
+        return 0;
+    }
+    trace->inBuf = (uint8_t *) malloc(DICT_BUFFER_BYTES);
+    trace->in = trace->inEnd = trace->inBuf;
+    return 1;
+}
+
+//------------------------------------//
+//          Binary Traces             //
+//------------------------------------//
+
+// Move to the next frame of a seekable trace, returns False at the end
+static int
+next_frame(trace_t *trace) {
+    const uint8_t *data;
+    size_t len;
+    int ret = seekable_next(trace->seek, &data, &len);
+    if (ret < 0) {
+        fprintf(stderr, "Corrupt frame in seekable trace\n");
+        trace->error = 1;
+    }
+    if (ret != 1) {
+        trace->cur = trace->end = NULL;
+        return 0;
+    }
+
+    trace->cur = data;
+    trace->end = data + len;
+    return 1;
+}
+
+// Fold a whole block into the checksum
+static uint64_t
+checksum_block(uint64_t sum, const uint8_t *block) {
+    const uint64_t *words = (const uint64_t *) block;
+    for (size_t i = 0; i < TRACE_BLOCK_BYTES / sizeof(uint64_t); i++) {
+        sum = trace_checksum(sum, words[i]);
+    }
+    return sum;
+}
+
+// Move to the next block, returns False at the end of the trace
+static int
+next_block(trace_t *trace) {
+    if (trace->index >= trace->count) {
+        return 0;
+    }
+
+    const uint8_t *block;
+    if (trace->seek != NULL) {
+        if (trace->cur == trace->end && !next_frame(trace)) {
+            return 0;
+        }
+        block = trace->cur;
+        trace->cur += TRACE_BLOCK_BYTES;
+    } else if (trace->map != NULL) {
+        if (trace->next + TRACE_BLOCK_BYTES > trace->map + trace->mapLen) {
+            fprintf(stderr, "Binary trace is truncated\n");
+            trace->error = 1;
+            return 0;
+        }
+        block = trace->next;
+        trace->next += TRACE_BLOCK_BYTES;
+    } else {
+        if (!read_bytes(trace, trace->block, TRACE_BLOCK_BYTES)) {
+            fprintf(stderr, "Binary trace is truncated\n");
+            trace->error = 1;
+            return 0;
+        }
+        block = trace->block;
+    }
+
+    trace->checksum = checksum_block(trace->checksum, block);
+    trace->pcs = (const uint32_t *) block;
+    memcpy(&trace->outcomes, block + TRACE_BLOCK_BRANCHES * sizeof(uint32_t), sizeof(uint64_t));
+    trace->slot = 0;
+    uint64_t left = trace->count - trace->index;
+    trace->slots = (left < TRACE_BLOCK_BRANCHES) ? (uint32_t) left : TRACE_BLOCK_BRANCHES;
+
+    if (!trace->unchecked && trace->index + trace->slots == trace->count &&
+        trace->checksum != trace->expected) {
+        fprintf(stderr, "Binary trace checksum mismatch\n");
+        trace->error = 1;
+    }
+    return 1;
+}
+
+// Copy up to 'max' branches, a block at a time
+static size_t
+read_binary(trace_t *trace, uint32_t *pcs, uint8_t *outcomes, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+        if (trace->slot == trace->slots && !next_block(trace)) {
+            break;
+        }
+        size_t take = trace->slots - trace->slot;
+        take = (take < max - n) ? take : max - n;
+        memcpy(pcs + n, trace->pcs + trace->slot, take * sizeof(uint32_t));
+        for (size_t k = 0; k < take; k++) {
+            outcomes[n + k] = (trace->outcomes >> (trace->slot + k)) & 1;
+        }
+        trace->slot += take;
+        trace->index += take;
+        n += take;
+    }
+    return n;
+}
+
+// Start decoding the frames of a seekable trace
+static int
+open_seekable(trace_t *trace, int threads) {
+    trace->seek = (trace->pbz == NULL) ? seekable_open(trace->stream, threads) : NULL;
+    if (trace->seek == NULL) {
+        fprintf(stderr, "Bad seekable trace, or not a regular file\n");
+        return 0;
+    }
+    // every frame is checked on its own
+    trace->format = TRACE_BINARY;
+    trace->count = seekable_count(trace->seek);
+    trace->unchecked = 1;
+    return 1;
+}
+
+// Read the header and map the body if the stream is a regular file
+static int
+open_binary(trace_t *trace, int threads) {
+    trace_header_t header;
+    if (!read_bytes(trace, &header, sizeof(header))) {
+        fprintf(stderr, "Bad binary trace header\n");
+        return 0;
+    }
+    if (memcmp(header.magic, SEEKABLE_MAGIC, SEEKABLE_MAGIC_LEN) == 0) {
+        return open_seekable(trace, threads);
+    }
+    if (memcmp(header.magic, TRACE_DICT_MAGIC, TRACE_MAGIC_LEN) == 0) {
+        return open_dict(trace, &header);
+    }
+    if (memcmp(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0 ||
+        header.version != TRACE_VERSION) {
+        fprintf(stderr, "Bad binary trace header\n");
+        return 0;
+    }
+
+    trace->format = TRACE_BINARY;
+    trace->count = header.count;
+    trace->expected = header.checksum;
+    trace->checksum = TRACE_CHECKSUM_SEED;
+
+    if (map_stream(trace, sizeof(header))) {
+        trace->next = trace->map + sizeof(header);
+        return 1;
+    }
+
+    trace->block = (uint8_t *) malloc(TRACE_BLOCK_BYTES);
+    return 1;
+}
+
+//------------------------------------//
+//        Trace Functions             //
+//------------------------------------//
+
+trace_t *
+trace_open(const char *path, int threads) {
+    FILE *stream = (path == NULL) ? stdin : fopen(path, "r");
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    trace_t *trace = (trace_t *) calloc(1, sizeof(trace_t));
+    trace->stream = stream;
+    trace->format = TRACE_TEXT;
+
+    // Text traces always start with "0x", bzip2 with "BZh"
+    int first = getc(stream);
+    if (first != EOF) {
+        ungetc(first, stream);
+    }
+    if (first == 'B') {
+        trace->pbz = pbzip_open(stream, threads);
+        if (trace->pbz == NULL) {
+            fprintf(stderr, "Bad bzip2 trace header\n");
+            trace_close(trace);
+            return NULL;
+        }
+        first = next_chunk(trace) ? *trace->cur : EOF;
+    }
+    if (first == (unsigned char) TRACE_MAGIC[0] && !open_binary(trace, threads)) {
+        trace_close(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+int
+trace_read(trace_t *trace, uint32_t *pc, uint8_t *outcome) {
+    if (trace->format == TRACE_BINARY) {
+        return read_binary(trace, pc, outcome, 1) == 1;
+    } else if (trace->format == TRACE_DICTIONARY) {
+        return read_dict(trace, pc, NULL, outcome, 1) == 1;
+    }
+    return read_text(trace, pc, outcome, 1) == 1;
+}
+
+size_t
+trace_read_batch(trace_t *trace, uint32_t *pcs, uint8_t *outcomes, size_t max) {
+    if (trace->format == TRACE_BINARY) {
+        return read_binary(trace, pcs, outcomes, max);
+    } else if (trace->format == TRACE_DICTIONARY) {
+        return read_dict(trace, pcs, NULL, outcomes, max);
+    }
+    double start = seconds();
+    size_t n = read_text(trace, pcs, outcomes, max);
+    trace->stats.seconds += seconds() - start;
+    return n;
+}
+
+size_t
+trace_read_ids(trace_t *trace, uint32_t *pcs, uint32_t *ids, uint8_t *outcomes, size_t max) {
+    if (trace->format == TRACE_DICTIONARY) {
+        return read_dict(trace, pcs, ids, outcomes, max);
+    }
+
+    size_t n = trace_read_batch(trace, pcs, outcomes, max);
+    if (trace->ids.slots == NULL) {
+        id_map_init(&trace->ids);
+    }
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = id_of(&trace->ids, pcs[i]);
+    }
+    return n;
+}
+
+uint32_t
+trace_dictionary(const trace_t *trace, const uint32_t **pcs) {
+    if (trace->format == TRACE_DICTIONARY) {
+        *pcs = trace->dict;
+        return trace->dictSize;
+    }
+    *pcs = trace->ids.pcs;
+    return trace->ids.size;
+}
+
+void
+trace_stats(const trace_t *trace, trace_stats_t *stats) {
+    *stats = trace->stats;
+}
+
+int
+trace_format(const trace_t *trace) {
+    return trace->format;
+}
+
+int
+trace_error(const trace_t *trace) {
+    return trace->error;
+}
+
+int
+trace_seek(trace_t *trace, uint64_t branch) {
+    if (trace->format != TRACE_BINARY || (trace->seek == NULL && trace->map == NULL)) {
+        // read up to 'branch'
+        uint32_t pcs[TRACE_BLOCK_BRANCHES];
+        uint8_t outcomes[TRACE_BLOCK_BRANCHES];
+        while (branch > 0) {
+            size_t n = trace_read_batch(trace, pcs, outcomes,
+                                        (branch < TRACE_BLOCK_BRANCHES) ? branch : TRACE_BLOCK_BRANCHES);
+            if (n == 0) {
+                return 0;
+            }
+            branch -= n;
+        }
+        return 1;
+    }
+    if (branch > trace->count) {
+        return 0;
+    }
+    trace->unchecked = 1;
+    trace->slot = trace->slots = 0;
+
+    // jump to the block holding 'branch', within its frame for seekable traces
+    uint64_t first = 0;
+    if (trace->seek != NULL) {
+        first = seekable_seek(trace->seek, branch);
+        trace->cur = trace->end = NULL;
+    }
+    if (branch == trace->count) {
+        trace->index = branch;
+        return 1;
+    }
+    uint64_t blocks = (branch - first) / TRACE_BLOCK_BRANCHES;
+    if (trace->seek != NULL) {
+        if (!next_frame(trace)) {
+            return 0;
+        }
+        trace->cur += blocks * TRACE_BLOCK_BYTES;
+    } else {
+        trace->next = trace->map + sizeof(trace_header_t) + blocks * TRACE_BLOCK_BYTES;
+    }
+
+    trace->index = first + blocks * TRACE_BLOCK_BRANCHES;
+    if (!next_block(trace)) {
+        return 0;
+    }
+    trace->slot = (uint32_t) (branch - trace->index);
+    trace->index = branch;
+    return 1;
+}
+
+int64_t
+trace_length(const trace_t *trace) {
+    if (trace->format != TRACE_BINARY || (trace->seek == NULL && trace->map == NULL)) {
+        return -1;
+    }
+    return (int64_t) trace->count;
+}
+
+void
+trace_close(trace_t *trace) {
+    if (trace->pbz != NULL) {
+        pbzip_close(trace->pbz);
+    }
+    if (trace->seek != NULL) {
+        seekable_close(trace->seek);
+    }
+    if (trace->map != NULL) {
+        munmap(trace->map, trace->mapLen);
+    }
+    if (trace->stream != stdin) {
+        fclose(trace->stream);
+    }
+    free(trace->text);
+    free(trace->dict);
+    free(trace->inBuf);
+    id_map_free(&trace->ids);
+    free(trace->block);
+    free(trace);
+}
+
+int64_t
+trace_load(trace_t *trace, uint32_t **pcs, uint8_t **outcomes) {
+    size_t cap = 1 << 20;
+    int64_t count = 0;
+    *pcs = (uint32_t *) malloc(cap * sizeof(uint32_t));
+    *outcomes = (uint8_t *) malloc(cap);
+    size_t n;
+    while ((n = trace_read_batch(trace, *pcs + count, *outcomes + count, cap - count)) > 0) {
+        if ((size_t) (count += n) == cap) {
+            cap *= 2;
+            *pcs = (uint32_t *) realloc(*pcs, cap * sizeof(uint32_t));
+            *outcomes = (uint8_t *) realloc(*outcomes, cap);
+        }
+    }
+    return count;
+}
+
+// Fill 'block' with the next branches of 'trace', unused slots are zero
+//
+// Returns the number of branches in the block
+//
+static uint32_t
+fill_block(trace_t *trace, uint8_t *block) {
+    uint32_t *pcs = (uint32_t *) block;
+    uint8_t taken[TRACE_BLOCK_BRANCHES];
+    uint32_t slots = 0;
+
+    memset(block, 0, TRACE_BLOCK_BYTES);
+    for (size_t n; slots < TRACE_BLOCK_BRANCHES &&
+                   (n = trace_read_batch(trace, pcs + slots, taken + slots, TRACE_BLOCK_BRANCHES - slots)) > 0;
+         slots += n) {
+    }
+
+    uint64_t outcomes = 0;
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        outcomes |= (uint64_t) (taken[slot] & 1) << slot;
+    }
+    memcpy(block + TRACE_BLOCK_BRANCHES * sizeof(uint32_t), &outcomes, sizeof(uint64_t));
+    return slots;
+}
+
+int64_t
+trace_convert(trace_t *trace, const char *path) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        return -1;
+    }
+
+    // The header is rewritten once the count and checksum are known
+    trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    header.version = TRACE_VERSION;
+    header.checksum = TRACE_CHECKSUM_SEED;
+    fwrite(&header, sizeof(header), 1, out);
+
+    uint8_t block[TRACE_BLOCK_BYTES];
+    uint32_t slots;
+    while ((slots = fill_block(trace, block)) > 0) {
+        header.checksum = checksum_block(header.checksum, block);
+        fwrite(block, TRACE_BLOCK_BYTES, 1, out);
+        header.count += slots;
+    }
+
+    rewind(out);
+    fwrite(&header, sizeof(header), 1, out);
+    if (fclose(out) != 0) {
+        return -1;
+    }
+    return (int64_t) header.count;
+}
+
+int64_t
+trace_convert_seekable(trace_t *trace, const char *path, uint32_t frameBranches) {
+    seekable_writer_t *w = seekable_create(path, frameBranches);
+    if (w == NULL) {
+        return -1;
+    }
+
+    uint8_t block[TRACE_BLOCK_BYTES];
+    uint32_t slots;
+    int64_t count = 0;
+    int ok = 1;
+    while (ok && (slots = fill_block(trace, block)) > 0) {
+        ok = seekable_add(w, block, slots);
+        count += slots;
+    }
+
+    ok &= seekable_finish(w);
+    return ok ? count : -1;
+}
+
+// most executed first, then first seen
+typedef struct {
+    uint64_t executions;
+    uint32_t id;
+} id_rank_t;
+
+static int
+compare_ranks(const void *a, const void *b) {
+    const id_rank_t *x = (const id_rank_t *) a;
+    const id_rank_t *y = (const id_rank_t *) b;
+    if (x->executions != y->executions) {
+        return (x->executions > y->executions) ? -1 : 1;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// Append 'value' as a varint to 'buf', writing the buffer to 'out'
+// when it is nearly full
+static void
+put_varint(FILE *out, uint8_t *buf, size_t *len, uint32_t value) {
+    if (*len > DICT_BUFFER_BYTES - VARINT_MAX_BYTES) {
+        fwrite(buf, 1, *len, out);
+        *len = 0;
+    }
+    for (; value >= 0x80; value >>= 7) {
+        buf[(*len)++] = (uint8_t) (value | 0x80);
+    }
+    buf[(*len)++] = (uint8_t) value;
+}
+
+int64_t
+trace_convert_dictionary(trace_t *trace, const char *path) {
+    // The branches are spooled with first seen IDs, since the ranks are
+    // only known at the end, so memory holds one entry per PC
+    FILE *spool = tmpfile();
+    if (spool == NULL) {
+        return -1;
+    }
+    uint8_t *buf = (uint8_t *) malloc(DICT_BUFFER_BYTES);
+    size_t len = 0;
+    id_map_t map;
+    id_map_init(&map);
+    uint32_t rankCap = map.cap;
+    id_rank_t *ranks = (id_rank_t *) calloc(rankCap, sizeof(id_rank_t));
+    int64_t count = 0;
+
+    uint32_t pcs[CONVERT_BATCH];
+    uint8_t outcomes[CONVERT_BATCH];
+    size_t n;
+    while ((n = trace_read_batch(trace, pcs, outcomes, CONVERT_BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t id = id_of(&map, pcs[i]);
+            if (id == rankCap) {
+                ranks = (id_rank_t *) realloc(ranks, 2 * rankCap * sizeof(id_rank_t));
+                memset(ranks + rankCap, 0, rankCap * sizeof(id_rank_t));
+                rankCap *= 2;
+            }
+            ranks[id].id = id;
+            ranks[id].executions++;
+            put_varint(spool, buf, &len, (id << 1) | (outcomes[i] & 1));
+        }
+        count += n;
+    }
+    fwrite(buf, 1, len, spool);
+
+    // renumber by decreasing execution count
+    qsort(ranks, map.size, sizeof(id_rank_t), compare_ranks);
+    uint32_t *dictionary = (uint32_t *) malloc((map.size + 1) * sizeof(uint32_t));
+    uint32_t *renumber = (uint32_t *) malloc((map.size + 1) * sizeof(uint32_t));
+    for (uint32_t k = 0; k < map.size; k++) {
+        dictionary[k] = map.pcs[ranks[k].id];
+        renumber[ranks[k].id] = k;
+    }
+
+    // The header is rewritten once the checksum is known
+    FILE *out = (fflush(spool) == 0 && !ferror(spool)) ? fopen(path, "wb") : NULL;
+    trace_dict_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_DICT_MAGIC, TRACE_MAGIC_LEN);
+    header.version = TRACE_DICT_VERSION;
+    header.pcs = map.size;
+    header.count = (uint64_t) count;
+    header.checksum = TRACE_CHECKSUM_SEED;
+    if (out != NULL) {
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(dictionary, sizeof(uint32_t), map.size, out);
+    }
+
+    // read the spool back and write its varints with the final IDs
+    uint8_t *in = (uint8_t *) malloc(DICT_BUFFER_BYTES);
+    size_t inLen = 0;
+    size_t pos = 0;
+    len = 0;
+    rewind(spool);
+    int ok = out != NULL;
+    for (int64_t i = 0; ok && i < count; i++) {
+        if (inLen - pos < VARINT_MAX_BYTES) {
+            memmove(in, in + pos, inLen - pos);
+            inLen -= pos;
+            inLen += fread(in + inLen, 1, DICT_BUFFER_BYTES - inLen, spool);
+            pos = 0;
+            if (inLen == 0) {
+                ok = 0;
+                break;
+            }
+        }
+
+        uint32_t value = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = in[pos++];
+            value |= (uint32_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        value = (renumber[value >> 1] << 1) | (value & 1);
+        header.checksum = trace_checksum(header.checksum, value);
+        put_varint(out, buf, &len, value);
+    }
+
+    if (out != NULL) {
+        fwrite(buf, 1, len, out);
+        rewind(out);
+        fwrite(&header, sizeof(header), 1, out);
+        ok &= fclose(out) == 0;
+    }
+    fclose(spool);
+    free(buf);
+    free(in);
+    free(ranks);
+    free(dictionary);
+    free(renumber);
+    id_map_free(&map);
+    return ok ? count : -1;
+}
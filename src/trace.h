@@ -0,0 +1,184 @@
+//========================================================//
+//  trace.h                                               //
+//  Header file for the branch trace readers              //
+//                                                        //
+//  A trace is either the plain text format               //
+//  "0x<pc> <outcome>", the packed binary format or the   //
+//  dictionary format described below, optionally         //
+//  compressed with bzip2, or a seekable trace of zlib    //
+//  frames of binary blocks.                              //
+//  The format is detected on open.                       //
+//========================================================//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//------------------------------------//
+//        Trace Format Defines        //
+//------------------------------------//
+#define TRACE_TEXT        0
+#define TRACE_BINARY      1
+#define TRACE_DICTIONARY  2
+
+// Binary trace layout (little endian):
+//   header:  trace_header_t, 32 bytes
+//   body:    ceil(count / 64) blocks of TRACE_BLOCK_BYTES, each holding
+//            64 PCs as uint32_t followed by a uint64_t of outcome bits
+//            (bit i is the outcome of PC i). Unused slots of the last
+//            block are zero.
+// The checksum is computed over the body as 64-bit words, see
+// trace_checksum().
+#define TRACE_MAGIC         "\x89" "BPTRACE"
+#define TRACE_MAGIC_LEN     8
+#define TRACE_VERSION       1
+#define TRACE_BLOCK_BRANCHES 64
+#define TRACE_BLOCK_BYTES   (TRACE_BLOCK_BRANCHES * sizeof(uint32_t) + sizeof(uint64_t))
+
+typedef struct {
+    char magic[TRACE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t flags;      // reserved, 0
+    uint64_t count;      // number of branches
+    uint64_t checksum;   // checksum of the body
+} trace_header_t;
+
+// Dictionary trace layout (little endian):
+//   header:      trace_dict_header_t, 32 bytes
+//   dictionary:  'pcs' PCs as uint32_t, the PC of branch ID i is entry
+//                i. IDs are given by decreasing execution count.
+//   body:        one LEB128 varint per branch, (id << 1) | outcome, so
+//                the 64 most executed branches take one byte
+// The checksum folds every varint value with trace_checksum().
+#define TRACE_DICT_MAGIC    "\x89" "BPDICT\n"
+#define TRACE_DICT_VERSION  1
+
+typedef struct {
+    char magic[TRACE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t pcs;        // dictionary entries
+    uint64_t count;      // number of branches
+    uint64_t checksum;   // checksum of the varint values
+} trace_dict_header_t;
+
+typedef struct trace trace_t;
+
+// Text parsing statistics of a trace
+typedef struct {
+    uint64_t bytes;         // text read
+    uint64_t lines;
+    uint64_t malformed;     // lines skipped
+    double seconds;         // in trace_read_batch(), reads included
+    double readSeconds;     // reading the stream or the decompressed chunks
+} trace_stats_t;
+
+//------------------------------------//
+//      Trace Function Prototypes     //
+//------------------------------------//
+
+// Open the trace at 'path' (stdin if NULL) and detect its format.
+// bzip2 traces are decompressed on 'threads' worker threads.
+// Returns NULL if the file cannot be opened or has a bad header
+//
+trace_t *trace_open(const char *path, int threads);
+
+// Read the next branch of the trace
+//
+// Returns True if Successful
+//
+int trace_read(trace_t *trace, uint32_t *pc, uint8_t *outcome);
+
+// Read up to 'max' branches. Malformed text lines are skipped.
+//
+// Returns the number of branches read, less than 'max' only at the end
+//
+size_t trace_read_batch(trace_t *trace, uint32_t *pcs, uint8_t *outcomes, size_t max);
+
+// Read up to 'max' branches like trace_read_batch() and their dense
+// branch IDs: the dictionary IDs of a dictionary trace, for other
+// traces IDs given in order of first appearance
+//
+// Returns the number of branches read, less than 'max' only at the end
+//
+size_t trace_read_ids(trace_t *trace, uint32_t *pcs, uint32_t *ids, uint8_t *outcomes, size_t max);
+
+// PC of every branch ID given out so far, the whole dictionary of a
+// dictionary trace
+//
+// Returns the number of IDs
+//
+uint32_t trace_dictionary(const trace_t *trace, const uint32_t **pcs);
+
+// Text parsing statistics so far, all zero for binary traces
+//
+void trace_stats(const trace_t *trace, trace_stats_t *stats);
+
+// Continue reading at branch 'branch' of the trace. Seekable traces
+// decode only the frame holding it and mapped binary traces jump to
+// its block, other traces are read up to it.
+//
+// Returns True if Successful
+//
+int trace_seek(trace_t *trace, uint64_t branch);
+
+// Number of branches of a trace that trace_seek() reaches directly,
+// seekable and mapped binary traces
+//
+// Returns the number of branches, or -1 for other traces
+//
+int64_t trace_length(const trace_t *trace);
+
+// Format of an opened trace, TRACE_TEXT, TRACE_BINARY (also for
+// seekable traces) or TRACE_DICTIONARY
+//
+int trace_format(const trace_t *trace);
+
+// Whether a truncated body, a corrupt block or frame or a checksum
+// mismatch was found so far, the branches read are then unreliable
+//
+// Returns True if the trace is damaged
+//
+int trace_error(const trace_t *trace);
+
+// Close the trace and release its buffers
+//
+void trace_close(trace_t *trace);
+
+// Read the remainder of 'trace' into two arrays allocated with malloc,
+// one PC and one outcome per branch, freed by the caller
+//
+// Returns the number of branches read
+//
+int64_t trace_load(trace_t *trace, uint32_t **pcs, uint8_t **outcomes);
+
+// Write the remainder of 'trace' to 'path' in the binary format
+//
+// Returns the number of branches written, or -1 on error
+//
+int64_t trace_convert(trace_t *trace, const char *path);
+
+// Write the remainder of 'trace' to 'path' as a seekable trace of
+// frames of 'frameBranches' branches (see seekable.h)
+//
+// Returns the number of branches written, or -1 on error
+//
+int64_t trace_convert_seekable(trace_t *trace, const char *path, uint32_t frameBranches);
+
+// Write the remainder of 'trace' to 'path' as a dictionary trace. The
+// branches are spooled to a temporary file until the ranks are known.
+//
+// Returns the number of branches written, or -1 on error
+//
+int64_t trace_convert_dictionary(trace_t *trace, const char *path);
+
+// fold one 64-bit body word into the running checksum
+static inline uint64_t trace_checksum(uint64_t sum, uint64_t word) {
+    return (sum ^ word) * 0x100000001b3ULL;
+}
+
+#define TRACE_CHECKSUM_SEED 0xcbf29ce484222325ULL
+
+#endif
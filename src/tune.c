@@ -0,0 +1,264 @@
+//========================================================//
+//  tune.c                                                //
+//  Source file for the design-space auto-tuner           //
+//                                                        //
+//  Every trace is decoded once into memory. All the      //
+//  candidates within the budget run on a prefix of each  //
+//  trace, a candidate is pruned when a smaller or equal  //
+//  one is better by more than TUNE_MARGIN, and the       //
+//  survivors run on the full traces. Both passes are     //
+//  sweeps of (trace, candidate) jobs, see sweep.h.       //
+//========================================================//
+
+#include <stdlib.h>
+#include "predictor.h"
+#include "sweep.h"
+#include "trace.h"
+#include "tune.h"
+
+// Relative misprediction rate margin for pruning on the prefix
+#define TUNE_MARGIN 0.10
+
+// Search ranges
+#define GSHARE_MIN_BITS      1
+#define GSHARE_MAX_BITS      24
+#define TOURNAMENT_MIN_BITS  4
+#define TOURNAMENT_MAX_BITS  16
+#define CUSTOM_MAX_INDEX     16
+
+// Perceptron history lengths tried, theta is tried at 1/2, 3/4 and 1
+// of the 1.93 * h + 14 suggested by the paper
+static const int customHistory[] = {4, 8, 12, 13, 16, 20, 24, 28, 32, 40, 48, 64};
+
+typedef struct {
+    predictor_config_t config;
+    uint64_t bits;
+    double rate;        // mean misprediction rate over the traces
+    int pruned;
+} candidate_t;
+
+typedef struct {
+    candidate_t *list;
+    int size;
+    int cap;
+    uint64_t budget;
+} candidates_t;
+
+// Branches of one trace
+typedef struct {
+    uint32_t *pcs;
+    uint8_t *outcomes;
+    uint64_t count;
+} branches_t;
+
+//------------------------------------//
+//         Search Space Setup         //
+//------------------------------------//
+
+// add 'config' if it fits the budget
+static void
+add_candidate(candidates_t *c, int bpType, int g, int l, int i, int32_t t) {
+    predictor_config_t config = {0};
+    config.bpType = bpType;
+    config.ghistoryBits = g;
+    config.lhistoryBits = l;
+    config.pcIndexBits = i;
+    config.theta = t;
+    config.layout = DEFAULT_LAYOUT;
+
+    uint64_t bits = predictor_config_bits(&config);
+    if (bits > c->budget) {
+        return;
+    }
+    if (c->size == c->cap) {
+        c->cap = (c->cap == 0) ? 256 : 2 * c->cap;
+        c->list = (candidate_t *) realloc(c->list, c->cap * sizeof(candidate_t));
+    }
+    c->list[c->size].config = config;
+    c->list[c->size].bits = bits;
+    c->list[c->size].rate = 0;
+    c->list[c->size].pruned = 0;
+    c->size++;
+}
+
+static void
+enumerate_candidates(candidates_t *c) {
+    for (int g = GSHARE_MIN_BITS; g <= GSHARE_MAX_BITS; g++) {
+        add_candidate(c, GSHARE, g, 0, 0, 0);
+    }
+
+    for (int g = TOURNAMENT_MIN_BITS; g <= TOURNAMENT_MAX_BITS; g++) {
+        for (int l = TOURNAMENT_MIN_BITS; l <= TOURNAMENT_MAX_BITS; l++) {
+            for (int i = TOURNAMENT_MIN_BITS; i <= TOURNAMENT_MAX_BITS; i++) {
+                add_candidate(c, TOURNAMENT, g, l, i, 0);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < sizeof(customHistory) / sizeof(customHistory[0]); k++) {
+        int h = customHistory[k];
+        int32_t suggested = (int32_t) (1.93 * h + 14);
+        for (int i = 1; i <= CUSTOM_MAX_INDEX; i++) {
+            add_candidate(c, CUSTOM, h, 0, i, suggested / 2);
+            add_candidate(c, CUSTOM, h, 0, i, suggested * 3 / 4);
+            add_candidate(c, CUSTOM, h, 0, i, suggested);
+        }
+    }
+}
+
+//------------------------------------//
+//             Evaluation             //
+//------------------------------------//
+
+// Decode the trace at 'path' into memory
+//
+// Returns True if Successful
+//
+static int
+load_trace(const char *path, int threads, branches_t *b) {
+    trace_t *trace = trace_open(path, threads);
+    if (trace == NULL) {
+        return 0;
+    }
+
+    b->count = (uint64_t) trace_load(trace, &b->pcs, &b->outcomes);
+    int ok = !trace_error(trace);
+    trace_close(trace);
+    return ok;
+}
+
+// Set the mean misprediction rate of every candidate that is not
+// pruned, over the first 'limit' branches (0 for all) of every trace
+static void
+evaluate(candidates_t *c, branches_t *traces, int numTraces, uint32_t limit, int threads) {
+    sweep_job_t *jobs = (sweep_job_t *) calloc((size_t) c->size * numTraces, sizeof(sweep_job_t));
+    int n = 0;
+    for (int k = 0; k < c->size; k++) {
+        if (c->list[k].pruned) {
+            continue;
+        }
+        for (int t = 0; t < numTraces; t++) {
+            jobs[n].pcs = traces[t].pcs;
+            jobs[n].outcomes = traces[t].outcomes;
+            jobs[n].count = traces[t].count;
+            jobs[n].limit = limit;
+            jobs[n].config = c->list[k].config;
+            n++;
+        }
+    }
+
+    sweep_run(jobs, n, threads);
+
+    // jobs are in candidate order, numTraces per candidate
+    n = 0;
+    for (int k = 0; k < c->size; k++) {
+        if (c->list[k].pruned) {
+            continue;
+        }
+        double sum = 0;
+        for (int t = 0; t < numTraces; t++, n++) {
+            if (jobs[n].branches > 0) {
+                sum += 100.0 * jobs[n].mispredictions / jobs[n].branches;
+            }
+        }
+        c->list[k].rate = sum / numTraces;
+    }
+    free(jobs);
+}
+
+// order by storage, then by misprediction rate
+static int
+compare_candidates(const void *a, const void *b) {
+    const candidate_t *x = (const candidate_t *) a;
+    const candidate_t *y = (const candidate_t *) b;
+    if (x->bits != y->bits) {
+        return (x->bits < y->bits) ? -1 : 1;
+    }
+    if (x->rate != y->rate) {
+        return (x->rate < y->rate) ? -1 : 1;
+    }
+    return 0;
+}
+
+// Prune every candidate beaten by more than TUNE_MARGIN by a candidate
+// that uses at most as many bits, 'c' sorted by compare_candidates
+//
+// Returns the number of candidates pruned
+//
+static int
+prune(candidates_t *c) {
+    int pruned = 0;
+    double best = -1;
+    for (int k = 0; k < c->size; k++) {
+        if (best >= 0 && c->list[k].rate > best * (1 + TUNE_MARGIN)) {
+            c->list[k].pruned = 1;
+            pruned++;
+        }
+        if (best < 0 || c->list[k].rate < best) {
+            best = c->list[k].rate;
+        }
+    }
+    return pruned;
+}
+
+//------------------------------------//
+//              Tuning                //
+//------------------------------------//
+
+// Tune for 'budget' bits over 'numTraces' traces, pruning on the first
+// 'prefix' branches of each trace, with jobs on 'threads' threads
+//
+// Returns True if every trace could be opened
+//
+int
+tune_run(char **traces, int numTraces, uint64_t budget, uint32_t prefix,
+         int threads, FILE *out) {
+    branches_t *branches = (branches_t *) calloc(numTraces, sizeof(branches_t));
+    int ok = 1;
+    for (int t = 0; t < numTraces && ok; t++) {
+        if (!load_trace(traces[t], threads, &branches[t])) {
+            fprintf(stderr, "Cannot read trace %s\n", traces[t]);
+            ok = 0;
+        }
+    }
+
+    candidates_t c = {0};
+    c.budget = budget;
+    if (ok) {
+        enumerate_candidates(&c);
+
+        // prefix pass
+        evaluate(&c, branches, numTraces, prefix, threads);
+        qsort(c.list, c.size, sizeof(candidate_t), compare_candidates);
+        int pruned = prune(&c);
+
+        // full pass on the survivors
+        evaluate(&c, branches, numTraces, 0, threads);
+        qsort(c.list, c.size, sizeof(candidate_t), compare_candidates);
+
+        fprintf(out, "# %d candidates within %llu bits, %d pruned on the first %u branches\n",
+                c.size, (unsigned long long) budget, pruned, prefix);
+        fprintf(out, "config\tbits\tmispredict_rate\n");
+
+        // the frontier: every survivor better than all smaller ones
+        char name[64];
+        double best = -1;
+        for (int k = 0; k < c.size; k++) {
+            candidate_t *cand = &c.list[k];
+            if (cand->pruned || (best >= 0 && cand->rate >= best)) {
+                continue;
+            }
+            best = cand->rate;
+            predictor_config_name(&cand->config, name, sizeof(name));
+            fprintf(out, "%s\t%llu\t%.3f\n", name, (unsigned long long) cand->bits, cand->rate);
+        }
+    }
+
+    for (int t = 0; t < numTraces; t++) {
+        free(branches[t].pcs);
+        free(branches[t].outcomes);
+    }
+    free(branches);
+    free(c.list);
+    return ok;
+}
@@ -0,0 +1,27 @@
+//========================================================//
+//  tune.h                                                //
+//  Header file for the design-space auto-tuner           //
+//                                                        //
+//  Searches gshare, tournament and perceptron sizes      //
+//  (and theta) that fit a storage budget, prunes the     //
+//  clearly losing ones on a prefix of every trace and    //
+//  reports the Pareto frontier of misprediction rate     //
+//  versus storage on the full traces.                    //
+//========================================================//
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Tune for 'budget' bits over 'numTraces' traces, pruning on the first
+// 'prefix' branches of each trace, with jobs on 'threads' threads.
+// The frontier is printed to 'out' as a tab separated table.
+//
+// Returns True if every trace could be opened
+//
+int tune_run(char **traces, int numTraces, uint64_t budget, uint32_t prefix,
+             int threads, FILE *out);
+
+#endif
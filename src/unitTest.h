@@ -12,5 +12,5 @@
  * */
 extern uint32_t failedCounter;
 
-void assert_equal(char* testName, uint32_t a, uint32_t b);
+void assert_equal(const char* testName, uint32_t a, uint32_t b);
 #endif //CSE240A_UNITTEST_H
@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+# Check sampled simulation against full runs on every bundled trace:
+# for each predictor, print the full misprediction rate, the sampled
+# estimate with its 95% confidence interval, whether the full rate lies
+# inside it, and the wall time of both runs. Fails when the full rate
+# falls outside the interval clearly more often than 5% of the time
+# with functional warming. Schedules with a warm-up leave the tables
+# colder, their interval covers the sampling error only and is not
+# checked.
+# usage: ./validateSampling.sh [<period>:<interval>[:<warmup>] ...]
+
+FILES="../traces/*"
+SCHEDULES=${@:-1000:100 10000:1000 10000:1000:4000}
+PREDICTORS="gshare:13 tournament:9:10:10 custom tage"
+
+make clean > /dev/null
+make > /dev/null || exit 1
+
+# decode every trace once, so the runs measure the predictor and not bzip2
+BINDIR=$(mktemp -d)
+for f in $FILES
+do
+  ./predictor --convert:$BINDIR/$(basename $f .bz2).bpt $f > /dev/null
+done
+
+# run once, set MS to the wall time and RATE, HALF to the reported
+# misprediction rate and confidence interval
+measure() {
+  local start end
+  start=$(date +%s%N)
+  read RATE HALF <<< "$("$@" | awk '/Misprediction Rate/ { print $3, $5 }')"
+  end=$(date +%s%N)
+  MS=$(( (end - start) / 1000000 ))
+}
+
+# inside and total of the schedules with functional warming, then of
+# those with a warm-up
+inside=0
+total=0
+warmInside=0
+warmTotal=0
+printf "%-8s %-20s %-22s %8s %8s %8s %6s %8s %8s\n" "Trace" "Config" "Schedule" "full" "sampled" "95% +-" \
+       "inside" "full ms" "samp ms"
+for f in $BINDIR/*.bpt
+do
+  for p in $PREDICTORS
+  do
+    measure ./predictor --$p $f
+    full=$RATE
+    full_ms=$MS
+    for s in $SCHEDULES
+    do
+      measure ./predictor --$p --sample:$s $f
+      rate=$RATE
+      half=$HALF
+      sample_ms=$MS
+      ok=$(awk -v f=$full -v r=$rate -v h=$half 'BEGIN { print (f >= r - h - 0.0005 && f <= r + h + 0.0005) ? "yes" : "no" }')
+      if [ $(echo $s | tr -cd : | wc -c) = 1 ]
+      then
+        [ $ok = yes ] && inside=$((inside + 1))
+        total=$((total + 1))
+      else
+        [ $ok = yes ] && warmInside=$((warmInside + 1))
+        warmTotal=$((warmTotal + 1))
+      fi
+      printf "%-8s %-20s %-22s %8s %8s %8s %6s %8s %8s\n" "$(basename $f .bpt)" "$p" "$s" "$full" "$rate" "$half" \
+             "$ok" "$full_ms" "$sample_ms"
+    done
+  done
+done
+echo "Full rate inside the confidence interval: $inside of $total with functional warming," \
+     "$warmInside of $warmTotal with a warm-up (not checked)"
+
+# clearly under nominal: as few inside has a binomial probability below
+# 1% when each run is inside with probability 0.95
+p=$(awk -v n=$total -v k=$inside 'BEGIN {
+  pmf = 0.05 ^ n; cdf = pmf
+  for (i = 0; i < k; i++) { pmf *= (n - i) / (i + 1) * 0.95 / 0.05; cdf += pmf }
+  print (n > 0) ? cdf : 1 }')
+status=0
+if awk -v p=$p 'BEGIN { exit !(p < 0.01) }'
+then
+  echo "Coverage is clearly under 95% (p = $p)"
+  status=1
+fi
+
+rm -rf $BINDIR
+make clean > /dev/null
+exit $status